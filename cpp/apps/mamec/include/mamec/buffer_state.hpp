@@ -1,7 +1,6 @@
 #pragma once
 
-#include <memory>
-#include <unordered_map>
+#include <vector>
 
 #include <stdint.h>
 
@@ -9,40 +8,126 @@
 #include "mamec/operation.hpp"
 
 namespace mamefont::mamec {
-class BufferStateClass;
-using BufferState = std::shared_ptr<BufferStateClass>;
-class BufferStateClass {
+
+using state_index_t = uint32_t;
+
+static constexpr state_index_t NO_STATE = 0xFFFFFFFF;
+
+// A node of the search trie. Nodes are plain data and refer to each other by
+// index into the BufferStateArena that owns them.
+struct BufferState {
+  int32_t pos;
+  int32_t bestCost;
+  state_index_t parent;
+  state_index_t bestPrev;
+  uint32_t bestOpr;
+  frag_t lastFrag;
+};
+
+// Owns all nodes of the search trie of a single glyph. Everything is released
+// at once when the arena goes out of scope.
+class BufferStateArena {
  public:
-  const size_t id;
-  const int pos;
-  const frag_t lastFrag;
+  std::vector<BufferState> states;
+  std::vector<OperationDesc> operations;
+
+  BufferStateArena() {
+    states.reserve(1024);
+    childSlots.resize(2048, NO_STATE);
+  }
+
+  inline BufferState &operator[](state_index_t index) { return states[index]; }
+  inline const BufferState &operator[](state_index_t index) const {
+    return states[index];
+  }
+
+  inline size_t size() const { return states.size(); }
+
+  // Bytes allocated for the trie
+  inline size_t memoryUsage() const {
+    return states.capacity() * sizeof(BufferState) +
+           operations.capacity() * sizeof(OperationDesc) +
+           childSlots.capacity() * sizeof(state_index_t);
+  }
+
+  inline state_index_t newRoot() { return newState(NO_STATE, 0, 0); }
+
+  // Returns the child of `parent` whose last fragment is `frag`, creating it
+  // if it does not exist yet.
+  inline state_index_t child(state_index_t parent, frag_t frag) {
+    size_t mask = childSlots.size() - 1;
+    size_t slot = hashOf(parent, frag) & mask;
+    while (true) {
+      state_index_t index = childSlots[slot];
+      if (index == NO_STATE) break;
+      const BufferState &s = states[index];
+      if (s.parent == parent && s.lastFrag == frag) return index;
+      slot = (slot + 1) & mask;
+    }
 
-  int bestCost = DUMMY_COST;
-  Operation bestOpr = nullptr;
-  BufferState bestPrev = nullptr;
+    state_index_t index = newState(parent, states[parent].pos + 1, frag);
+    childSlots[slot] = index;
+    if (states.size() * 2 > childSlots.size()) {
+      rehash(childSlots.size() * 2);
+    }
+    return index;
+  }
 
-  BufferState parentState = nullptr;
-  std::unordered_map<frag_t, BufferState> childState;
+  inline void setBestOperation(state_index_t index, const OperationDesc &opr) {
+    states[index].bestOpr = operations.size();
+    operations.push_back(opr);
+  }
 
-  BufferStateClass(int pos, frag_t lastFrag, BufferState parent)
-      : id(nextObjectId()), pos(pos), lastFrag(lastFrag), parentState(parent) {}
+  inline const OperationDesc &bestOperation(state_index_t index) const {
+    return operations[states[index].bestOpr];
+  }
 
-  inline void copyPastTo(std::vector<frag_t> &dest, int negativeOffset,
-                         int length) const {
-    const BufferStateClass *p = this;
+  inline void copyPastTo(state_index_t index, std::vector<frag_t> &dest,
+                         int negativeOffset, int length) const {
     int numSkip = negativeOffset - length;
     for (int i = 0; i < numSkip; i++) {
-      if (p) p = p->parentState.get();
+      if (index != NO_STATE) index = states[index].parent;
     }
     for (int i = 0; i < length; i++) {
-      if (p) {
-        dest[length - 1 - i] = p->lastFrag;
-        p = p->parentState.get();
+      if (index != NO_STATE) {
+        dest[length - 1 - i] = states[index].lastFrag;
+        index = states[index].parent;
       } else {
         dest[length - 1 - i] = 0;
       }
     }
   }
+
+ private:
+  // Flat open-addressing table of child links, keyed by (parent, lastFrag).
+  // The key is not stored; it is read back from the child node itself.
+  std::vector<state_index_t> childSlots;
+
+  static inline size_t hashOf(state_index_t parent, frag_t frag) {
+    uint64_t h = ((uint64_t)parent << 8) | frag;
+    h *= 0x9E3779B97F4A7C15ull;
+    return h >> 32;
+  }
+
+  inline state_index_t newState(state_index_t parent, int pos, frag_t frag) {
+    state_index_t index = states.size();
+    states.push_back(BufferState{pos, DUMMY_COST, parent, NO_STATE, 0, frag});
+    return index;
+  }
+
+  void rehash(size_t numSlots) {
+    childSlots.assign(numSlots, NO_STATE);
+    size_t mask = numSlots - 1;
+    for (state_index_t index = 0; index < states.size(); index++) {
+      const BufferState &s = states[index];
+      if (s.parent == NO_STATE) continue;
+      size_t slot = hashOf(s.parent, s.lastFrag) & mask;
+      while (childSlots[slot] != NO_STATE) {
+        slot = (slot + 1) & mask;
+      }
+      childSlots[slot] = index;
+    }
+  }
 };
 
 }  // namespace mamefont::mamec
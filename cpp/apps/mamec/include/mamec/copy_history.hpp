@@ -0,0 +1,82 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include <stdint.h>
+
+#include "mamec/buffer_state.hpp"
+#include "mamec/mamec_common.hpp"
+#include "mamec/masked_compare.hpp"
+#include "mamec/vec_ref.hpp"
+
+namespace mamefont::mamec {
+
+// The fragments most recently written before a search state, indexed by value
+// so copy sources can be looked up instead of scanned. It is reloaded for
+// every expanded state and reuses its buffers.
+class CopyHistory {
+ public:
+  static constexpr int WINDOW_SIZE = mf::CPX::Offset::MAX;
+
+  // Oldest first; window[WINDOW_SIZE - 1] is the last written fragment.
+  // Positions before the start of the glyph read as zero, as in the decoder.
+  std::vector<frag_t> window;
+
+  CopyHistory() : window(WINDOW_SIZE) {}
+
+  inline void load(const BufferStateArena &arena, state_index_t index) {
+    arena.copyPastTo(index, window, WINDOW_SIZE, WINDOW_SIZE);
+    for (int i = 0; i < 256; i++) head[i] = -1;
+    for (int pos = 0; pos < WINDOW_SIZE; pos++) {
+      frag_t frag = window[pos];
+      next[pos] = head[frag];
+      head[frag] = pos;
+    }
+  }
+
+  // Calls `func(pos)` for every window position that holds `frag`, newest
+  // first, until it returns false.
+  template <typename Func>
+  inline void forEachPosition(frag_t frag, Func func) const {
+    for (int pos = head[frag]; pos >= 0; pos = next[pos]) {
+      if (!func(pos)) break;
+    }
+  }
+
+  // Number of leading future fragments matched by copying from `pos` with
+  // `cpxFlags`. The copy walks towards older fragments when ByteReverse is
+  // set, otherwise towards newer ones.
+  inline int matchLength(int pos, uint8_t cpxFlags, const VecRef &future,
+                         const VecRef &compareMask, int maxLength) const {
+    if (pos < 0 || WINDOW_SIZE <= pos) return 0;
+    bool byteReverse = mf::CPX::ByteReverse::read(cpxFlags);
+    int available = byteReverse ? (pos + 1) : (WINDOW_SIZE - pos);
+    int length = std::min({maxLength, available, (int)future.size,
+                           (int)compareMask.size});
+    if (length <= 0) return 0;
+    return maskedMatchLength(&window[pos], &future.vector[future.start],
+                             &compareMask.vector[compareMask.start], length,
+                             cpxFlags, future.bpp);
+  }
+
+  // Appends the fragments a copy from window[from..from+length) produces.
+  inline void copyOut(int from, int length, uint8_t cpxFlags,
+                      mf::PixelFormat bpp, std::vector<frag_t> &dest) const {
+    bool byteReverse = mf::CPX::ByteReverse::read(cpxFlags);
+    bool pixelReverse = mf::CPX::PixelReverse::read(cpxFlags);
+    bool inverse = mf::CPX::Inverse::read(cpxFlags);
+    for (int i = 0; i < length; i++) {
+      frag_t frag = window[byteReverse ? (from + length - 1 - i) : (from + i)];
+      if (pixelReverse) frag = mf::reversePixels(frag, bpp);
+      if (inverse) frag = ~frag;
+      dest.push_back(frag);
+    }
+  }
+
+ private:
+  int16_t head[256];
+  int16_t next[WINDOW_SIZE];
+};
+
+}  // namespace mamefont::mamec
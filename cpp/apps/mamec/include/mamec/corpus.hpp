@@ -0,0 +1,19 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+#include "mamec/mamec_common.hpp"
+
+namespace mamefont::mamec {
+
+// Number of occurrences of each character code in a text corpus
+using CorpusCount = std::map<int, int>;
+
+// Counts the characters of a UTF-8 text file. Line breaks are not counted.
+CorpusCount loadCorpus(const std::string &path);
+
+// Total number of characters in `corpus`
+int corpusSize(const CorpusCount &corpus);
+
+}  // namespace mamefont::mamec
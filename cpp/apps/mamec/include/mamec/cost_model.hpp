@@ -0,0 +1,65 @@
+#pragma once
+
+#include "mamec/mamec_common.hpp"
+#include "mamec/operation.hpp"
+
+namespace mamefont::mamec {
+
+// What the glyph search minimizes
+enum class CostModel {
+  // Byte code size, see baseCostOf()
+  SIZE,
+  // Estimated decoder cycles, with byte code size only breaking ties
+  SPEED,
+  // SIZE and SPEED weighted by CostParams::speedWeight
+  BLEND,
+};
+
+// Estimated decoder cycles of an instruction on an 8-bit AVR: a fixed part
+// for fetching, dispatching and setting up the instruction, plus a part for
+// each fragment it generates.
+struct DecodeCycles {
+  int perInst;
+  int perFrag;
+};
+
+DecodeCycles decodeCyclesOf(mf::Operator op, mf::PixelFormat bpp);
+
+// Estimated decoder cycles of `numInsts` instructions of `op` that generate
+// `numFrags` fragments in total
+static inline int estimateDecodeCycles(mf::Operator op, int numInsts,
+                                       int numFrags, mf::PixelFormat bpp) {
+  DecodeCycles cycles = decodeCyclesOf(op, bpp);
+  return cycles.perInst * numInsts + cycles.perFrag * numFrags;
+}
+
+// Same as above for a single operation, including the CPX flags
+int estimateDecodeCycles(const OperationDesc &desc, mf::PixelFormat bpp);
+
+// Estimated decoder cycles spent on a glyph besides its instructions:
+// looking it up, setting up the decoder and, for glyphs that use the
+// alternative top or bottom, clearing the buffer
+int estimateGlyphSetupCycles(int numFrags, bool clearsBuffer);
+
+struct CostParams {
+  CostModel model = CostModel::SIZE;
+  mf::PixelFormat pixelFormat = mf::PixelFormat::BW_1BIT;
+  // Share of the decoder cycles in the cost, in percent. 0 for SIZE and 100
+  // for SPEED.
+  int speedWeight = 0;
+  // The cost is the decoder cycles alone, for bounding them in the search
+  bool cyclesOnly = false;
+
+  // Cost of `desc`, whose `cost` field holds the cost by size
+  int costOf(const OperationDesc &desc) const;
+
+  // Lowest cost that `op` can have when it generates `outputLength`
+  // fragments, for the search heuristic
+  int minCostOf(mf::Operator op, int outputLength,
+                int additionalCost = 0) const;
+
+ private:
+  int blend(int sizeCost, int cycles) const;
+};
+
+}  // namespace mamefont::mamec
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "mamec/glyph_object.hpp"
+#include "mamec/mamec_common.hpp"
+#include "mamec/operation.hpp"
+
+namespace mamefont::mamec {
+
+// Bump whenever the glyph search may produce different operations for the
+// same input, so that caches written by older encoders are ignored.
+static constexpr int ENCODER_VERSION = 2;
+
+// Operations found by the glyph search, remembered by the input of the
+// search: the fragments, the compare mask, the barriers inside the glyph, its
+// speed weight and which of the fragments the glyph could load are in the
+// fragment table.
+// Glyphs with the same input get the same operations without being searched
+// again. LUP indices are remapped to the current table when restored.
+//
+// With a directory set, entries are also written to and read from files, so
+// they survive across runs.
+class EncodeCache {
+ public:
+  // Anything besides the glyph that affects the search result, such as the
+  // encoder options. Entries made with a different signature never match.
+  std::string signature;
+
+  // Enables the on-disk cache. The directory is created if needed.
+  void setDirectory(const std::string &dir);
+
+  // FNV-1a hash of the search input of `glyph`
+  uint64_t keyOf(const GlyphObject &glyph,
+                 const std::vector<frag_t> &fragTable) const;
+
+  // Whether both glyphs give the search the same input, apart from the
+  // fragment table
+  static bool sameInput(const GlyphObject &a, const GlyphObject &b);
+
+  // Copies the operations stored for the same input into `glyph`. Barrier
+  // flags are set for the barriers of `glyph` itself. Returns false if there
+  // is no such entry.
+  bool restore(GlyphObject &glyph, const std::vector<frag_t> &fragTable);
+
+  void store(const GlyphObject &glyph, const std::vector<frag_t> &fragTable);
+
+  inline size_t size() const { return numEntries; }
+
+ private:
+  struct Entry {
+    std::vector<frag_t> fragments;
+    std::vector<frag_t> compareMask;
+    std::vector<int> barriers;
+    int speedWeight;
+    std::vector<frag_t> loadableFrags;
+    std::vector<Operation> operations;
+  };
+
+  // Entries with colliding keys are told apart by comparing the input itself
+  std::map<uint64_t, std::vector<Entry>> entries;
+  size_t numEntries = 0;
+  std::string directory;
+
+  const Entry *find(uint64_t key, const GlyphObject &glyph,
+                    const std::vector<frag_t> &loadableFrags) const;
+  std::string pathOf(uint64_t key) const;
+  bool loadFile(uint64_t key);
+  void saveFile(uint64_t key, const Entry &entry) const;
+};
+
+}  // namespace mamefont::mamec
@@ -1,17 +1,44 @@
 #pragma once
 
+#include <array>
 #include <map>
 #include <memory>
+#include <stdexcept>
 
 #include "mamec/bitmap_font.hpp"
 #include "mamec/buffer_state.hpp"
+#include "mamec/copy_history.hpp"
+#include "mamec/corpus.hpp"
+#include "mamec/cost_model.hpp"
+#include "mamec/encode_cache.hpp"
 #include "mamec/glyph_object.hpp"
 #include "mamec/mamec_common.hpp"
 #include "mamec/operation.hpp"
+#include "mamec/search_heuristic.hpp"
+#include "mamec/search_stats.hpp"
+#include "mamec/state_queue.hpp"
 #include "mamec/vec_ref.hpp"
 
 namespace mamefont::mamec {
 
+// How hard the glyph search tries to find the cheapest operations
+enum class Effort {
+  // Greedy: always takes the candidate that looks best from where it is
+  FAST,
+  // Best-first, but each state only follows its most efficient candidates
+  BALANCED,
+  // Best-first until the cheapest solution is proven
+  OPTIMAL,
+};
+
+// How the fragment table is chosen from the operations of the glyphs
+enum class FragTableSelector {
+  // The most frequently loaded fragments
+  COUNT,
+  // The fragments that save the most bytes, if smaller than by COUNT
+  SIZE,
+};
+
 struct EncodeOptions {
   bool verbose = true;
   int verboseForCode = -1;
@@ -20,11 +47,93 @@ struct EncodeOptions {
   bool noCpx = false;
   bool noSfi = false;
   bool forceZeroPadding = false;
+  // 0 for the number of hardware threads
+  int numThreads = 1;
+  QueueBackend queueBackend = QueueBackend::BUCKET;
+  Heuristic heuristic = Heuristic::SUFFIX;
+  Effort effort = Effort::OPTIMAL;
+  std::string cacheDir;
+  std::string searchStatsPath;
+  // Upper limit of encodePass() rounds; see Encoder::encode()
+  int maxPasses = 1;
+  FragTableSelector fragTableSelector = FragTableSelector::SIZE;
+  CostModel costModel = CostModel::SIZE;
+  // Share of the decoder cycles in the cost under CostModel::BLEND, in percent
+  int speedWeight = 50;
+  // Characters the firmware renders. When given, each glyph is weighted
+  // between size and speed by its frequency instead of by costModel.
+  CorpusCount corpus;
+  // Upper limit of the estimated decode cycles of any glyph, 0 for none
+  int maxGlyphCycles = 0;
+};
+
+// Thrown by the glyph search when no operations fit in the cycle budget
+class CycleBoundError : public std::runtime_error {
+ public:
+  using std::runtime_error::runtime_error;
+};
+
+// Fragment table and operations of all glyphs, to go back to after trying
+// something that did not pay off
+struct EncodeSnapshot {
+  std::vector<frag_t> fragTable;
+  std::map<int, std::vector<Operation>> operations;
+};
+
+// An operation generated for the state being expanded. Its output is stored
+// in SearchContext::candidateOutput.
+struct OperationCandidate {
+  OperationDesc desc;
+  uint32_t outputStart;
+};
+
+// State owned by a single glyph search. Nothing in here is shared between
+// glyphs, so searches can run concurrently and still produce the same result
+// regardless of the scheduling.
+struct SearchContext {
+  BufferStateArena arena;
+  CopyHistory history;
+  std::vector<int8_t> cpxMatchLength;
+
+  // Fragments that match the glyph at each position, in ascending order
+  std::vector<std::vector<frag_t>> loadCandidates;
+  // Whether any of them is in the fragment table
+  std::vector<bool> lupLoadable;
+
+  // Cleared for every expanded state but keep their capacity, so generating
+  // candidates does not allocate once the search has warmed up.
+  std::vector<OperationCandidate> candidates;
+  std::vector<frag_t> candidateOutput;
+
+  SearchStats stats;
+
+  // The generators describe operations by their size; this replaces that
+  // cost according to the cost model.
+  CostParams cost;
+
+  // Cycles the instructions of the glyph may take, 0 if unbounded, and a
+  // lower bound of the cycles still needed from each position
+  int maxCycles = 0;
+  std::vector<int> minRemainingCycles;
+  // Cycles along the best path to each state, only kept with a budget
+  std::vector<int32_t> bestCycles;
+
+  // Whether a path that took `cycles` to reach `pos` can still finish within
+  // the budget
+  inline bool withinBudget(int cycles, int pos) const {
+    return maxCycles <= 0 || cycles + minRemainingCycles[pos] <= maxCycles;
+  }
+
+  inline void addCandidate(const OperationDesc &desc, int outputStart) {
+    candidates.push_back(OperationCandidate{desc, (uint32_t)outputStart});
+    candidates.back().desc.cost = cost.costOf(desc);
+  }
 };
 
 struct TryContext {
   const int code;
-  std::vector<Operation> &oprs;
+  SearchContext &search;
+  const state_index_t stateIndex;
   const BufferState &state;
   const VecRef &future;
   const VecRef &compareMask;
@@ -42,10 +151,11 @@ class Encoder {
   mf::PixelFormat pixelFormat = mf::PixelFormat::BW_1BIT;
   std::map<int, GlyphObject> glyphs;
   std::vector<frag_t> fragTable;
-  std::map<frag_t, int> ldiFrags;
   std::vector<uint8_t> blob;
+  EncodeCache searchCache;
+  std::map<int, SearchStats> searchStats;
 
-  Encoder(EncodeOptions opts) : options(opts){};
+  Encoder(EncodeOptions opts) : options(opts) { fragIndex.fill(-1); };
 
   void addFont(const BitmapFont &font);
   void encode();
@@ -104,8 +214,31 @@ class Encoder {
   void determineAltTopBottom(const BitmapFont &font);
   void addGlyph(const BitmapFont &font, const BitmapGlyph &glyph);
   void detectFragmentDuplications(std::string indent);
-  void generateInitialOperations(GlyphObject &glyph, bool verbose = false,
-                                 std::string indent = "");
+  int encodePass(int pass);
+  int finishFragTable(const std::string &label);
+  int encodedSize() const;
+  EncodeSnapshot snapshot() const;
+  void restore(const EncodeSnapshot &snap);
+  void generateAllInitialOperations();
+  SearchStats generateInitialOperations(GlyphObject &glyph,
+                                        bool verbose = false,
+                                        std::string indent = "");
+  template <typename TQueue>
+  SearchStats searchOperations(GlyphObject &glyph, int speedWeight,
+                               bool verbose, std::string indent);
+  SearchStats greedyOperations(GlyphObject &glyph, int speedWeight,
+                               bool verbose, std::string indent);
+  state_index_t completeGreedily(SearchContext &search,
+                                 const GlyphObject &glyph, state_index_t curr,
+                                 int currCycles);
+  int speedWeightOf(int code) const;
+  void prepareSearch(SearchContext &search, const GlyphObject &glyph,
+                     int speedWeight);
+  void generateCandidates(SearchContext &search, const GlyphObject &glyph,
+                          state_index_t curr);
+  void storeOperations(GlyphObject &glyph, const BufferStateArena &arena,
+                       state_index_t first, state_index_t goal,
+                       std::string indent);
   void tryLUP(TryContext ctx);
   void tryXOR(TryContext ctx);
   void tryRPT(TryContext ctx);
@@ -118,12 +251,20 @@ class Encoder {
 
   void generateInitialFragTable();
   void generateFullFragTable();
+  void generateFragTableBySize();
   void generateFragTableFromCountMap(std::map<frag_t, int> &countMap,
                                      int tableSize);
   void optimizeFragmentTable();
+  void orderFragTableForLUD();
   void fixLUPIndex();
-  void replaceLDItoLUP(bool verbose = false, std::string indent = "");
-  int reverseLookup(frag_t frag);
+  int replaceLDItoLUP();
+  int reverseLookup(frag_t frag) const { return fragIndex[frag]; }
+  void eraseFragment(int index);
+  void updateFragIndex();
   void checkFragmentDuplicationSolvable();
+
+  // First index of each fragment in fragTable, or -1. Must be updated
+  // whenever fragTable changes.
+  std::array<int16_t, 256> fragIndex;
 };
 }  // namespace mamefont::mamec
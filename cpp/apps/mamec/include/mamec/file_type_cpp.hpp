@@ -3,11 +3,13 @@
 #include <string>
 #include <vector>
 
+#include "mamec/corpus.hpp"
 #include "mamec/mamec_common.hpp"
 
 namespace mamefont::mamec {
 
 void exportHpp(std::ostream &os, const std::vector<uint8_t> &blob,
-               std::string name);
+               std::string name, const CorpusCount &corpus = {},
+               const std::vector<uint8_t> &baselineBlob = {});
 
 }  // namespace mamefont::mamec
@@ -29,6 +29,10 @@ class GlyphObjectClass {
 
   std::vector<Operation> operations;
 
+  // Share of the decoder cycles in the search cost, in percent; see
+  // CostParams
+  int speedWeight = 0;
+
   int fragDupSrcCode = -1;
   std::map<int, bool> barrierPosForSolveFragDup;
 
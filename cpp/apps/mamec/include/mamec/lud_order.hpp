@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vector>
+
+#include "mamec/mamec_common.hpp"
+
+namespace mamefont::mamec {
+
+// Fragments loaded by consecutive LUP operations of a glyph, with no barrier
+// in between. Any two neighbours may be merged into a LUD.
+using LUPRun = std::vector<frag_t>;
+
+// Number of LUD that replaceLDItoLUP() makes out of `runs` with `table`.
+// It merges pairs from the front of each run, as soon as their indices
+// allow it.
+int countLUD(const std::vector<frag_t> &table, const std::vector<LUPRun> &runs);
+
+// Reorders `table` to maximize countLUD(). This is a maximum-weight path
+// cover over the first LUD::Index::MAX + 2 slots: solved exactly over the
+// pair counts when few fragments are involved, greedily by chaining the most
+// frequent pairs otherwise. The result is then refined by local search on
+// countLUD() itself, and is never worse than the order passed in.
+void orderTableForLUD(std::vector<frag_t> &table,
+                      const std::vector<LUPRun> &runs);
+
+}  // namespace mamefont::mamec
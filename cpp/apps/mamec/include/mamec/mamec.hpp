@@ -4,8 +4,11 @@
 #include "mamefont/mamefont.hpp"
 #include "mamec/bitmap_font.hpp"
 #include "mamec/encoder.hpp"
+#include "mamec/masked_compare.hpp"
 #include "mamec/verify.hpp"
 #include "mamec/file_type_json.hpp"
 #include "mamec/file_type_bmp.hpp"
 #include "mamec/file_type_cpp.hpp"
-#include "mamec/self_test.hpp"
\ No newline at end of file
+#include "mamec/self_test.hpp"
+#include "mamec/trace.hpp"
+#include "mamec/wcet.hpp"
\ No newline at end of file
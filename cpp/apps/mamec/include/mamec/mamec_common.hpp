@@ -8,6 +8,9 @@
 
 namespace mf = mamefont;
 
+#define FOR_FIELD_VALUES(field, value) \
+  for (int value = field::MIN; value <= field::MAX; value += field::STEP)
+
 namespace mamefont::mamec {
 
 using frag_t = mf::frag_t;
@@ -29,10 +32,6 @@ struct Duplication {
   Duplication() : sourceCode(-1), offset(0), size(0) {}
 };
 
-extern size_t objectId;
-
-static inline size_t nextObjectId() { return objectId++; }
-
 static inline bool maskedEqual(frag_t a, frag_t b, frag_t mask,
                                uint8_t cpxFlags, mf::PixelFormat bpp) {
   if (mf::CPX::PixelReverse::read(cpxFlags)) {
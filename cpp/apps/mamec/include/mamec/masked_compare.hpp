@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "mamec/mamec_common.hpp"
+
+namespace mamefont::mamec {
+
+// Returns how many leading fragments of `dst` are reproduced under `mask` by
+// reading `src` with the CPX transforms in `cpxFlags`. With ByteReverse set,
+// `src` points at the first fragment to read and is walked towards lower
+// addresses. No bounds checks are done here; all three arrays must hold
+// `length` fragments in their walking direction.
+int maskedMatchLength(const frag_t *src, const frag_t *dst, const frag_t *mask,
+                      int length, uint8_t cpxFlags, mf::PixelFormat bpp);
+
+// One fragment at a time. Used for short runs and as the reference for the
+// vectorized paths.
+int maskedMatchLengthScalar(const frag_t *src, const frag_t *dst,
+                            const frag_t *mask, int length, uint8_t cpxFlags,
+                            mf::PixelFormat bpp);
+
+// Name of the implementation picked for this CPU.
+const char *maskedCompareKernelName();
+
+}  // namespace mamefont::mamec
@@ -4,11 +4,15 @@
 #include <sstream>
 #include <vector>
 
+#include "mamec/corpus.hpp"
 #include "mamec/mamec_common.hpp"
 
 namespace mamefont::mamec {
 
+// With a corpus, the decode cycles expected per corpus character are also
+// reported, compared with `baselineBlob` if it is not empty.
 void dumpMetrics(const std::vector<uint8_t> &blob, std::ostream &os,
-                 const std::string &indent);
+                 const std::string &indent, const CorpusCount &corpus = {},
+                 const std::vector<uint8_t> &baselineBlob = {});
 
 }  // namespace mamec
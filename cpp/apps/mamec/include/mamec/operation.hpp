@@ -11,6 +11,35 @@ static constexpr int DUMMY_COST = 99999999;
 class OperationClass;
 using Operation = std::shared_ptr<OperationClass>;
 
+// Encoded form of an operation without its output fragments. The search
+// produces and stores these by value; only the operations on the best path
+// are turned into OperationClass objects.
+struct OperationDesc {
+  mf::Operator op;
+  uint8_t codeLength;
+  uint8_t code[3];
+  uint8_t outputLength;
+  int32_t cost;
+};
+
+static inline OperationDesc describeOperation(mf::Operator op,
+                                              int outputLength,
+                                              int additionalCost,
+                                              int byte0 = 0x00, int byte1 = -1,
+                                              int byte2 = -1) {
+  if (outputLength <= 0) {
+    throw std::runtime_error(std::string("Empty output fragments for ") +
+                             mf::mnemonicOf(op));
+  }
+  return OperationDesc{
+      op,
+      (uint8_t)(byte1 != -1 ? (byte2 != -1 ? 3 : 2) : 1),
+      {(uint8_t)(mf::baseCodeOf(op) | byte0), (uint8_t)byte1, (uint8_t)byte2},
+      (uint8_t)outputLength,
+      baseCostOf(op) + additionalCost,
+  };
+}
+
 class OperationClass {
  public:
   const mf::Operator op;
@@ -24,21 +53,25 @@ class OperationClass {
   bool afterBarrier = false;
   bool beforeBarrier = false;
 
-  OperationClass(mf::Operator op, const std::vector<frag_t> &output,
-                 int additionalCost, int byte0 = 0x00, int byte1 = -1,
-                 int byte2 = -1)
-      : op(op),
+  OperationClass(const OperationDesc &desc, const std::vector<frag_t> &output)
+      : op(desc.op),
         output(output),
-        cost(baseCostOf(op) + additionalCost),
-        codeLength(byte1 != -1 ? (byte2 != -1 ? 3 : 2) : 1),
-        code{(uint8_t)(mf::baseCodeOf(op) | byte0), (uint8_t)byte1,
-             (uint8_t)byte2} {
-    if (output.empty()) {
-      throw std::runtime_error(std::string("Empty output fragments for ") +
+        cost(desc.cost),
+        codeLength(desc.codeLength),
+        code{desc.code[0], desc.code[1], desc.code[2]} {
+    if (output.size() != desc.outputLength) {
+      throw std::runtime_error(std::string("Output length mismatch for ") +
                                mf::mnemonicOf(op));
     }
   }
 
+  OperationClass(mf::Operator op, const std::vector<frag_t> &output,
+                 int additionalCost, int byte0 = 0x00, int byte1 = -1,
+                 int byte2 = -1)
+      : OperationClass(describeOperation(op, output.size(), additionalCost,
+                                         byte0, byte1, byte2),
+                       output) {}
+
   inline void writeCodeTo(std::vector<uint8_t> &byteCode) const {
     byteCode.push_back(code[0]);
     if (codeLength > 1) {
@@ -58,18 +91,24 @@ static inline Operation makeOperation(mf::Operator op,
                                           byte1, byte2);
 }
 
+static inline Operation makeOperation(const OperationDesc &desc,
+                                      const std::vector<frag_t> &output) {
+  return std::make_shared<OperationClass>(desc, output);
+}
+
+OperationDesc describeLDI(frag_t frag, int addCost);
+OperationDesc describeXOR(int pos, bool width2bit);
+OperationDesc describeLUP(int index);
+OperationDesc describeLUD(int index, int step);
+OperationDesc describeRPT(int count);
+OperationDesc describeSFT(bool right, bool postSet, int size, int rpt);
+OperationDesc describeSFI(bool right, bool postSet, bool preShift, int period,
+                          int rpt);
+OperationDesc describeCPY(int offset, int length, bool byteReverse);
+OperationDesc describeCPX(int offset, int length, uint8_t cpxFlags);
+
 Operation makeLDI(frag_t frag, int addCost);
-Operation makeXOR(int pos, bool width2bit, frag_t frag);
 Operation makeLUP(int index, frag_t frag);
 Operation makeLUD(int index, int step, frag_t frag1, frag_t frag2);
-Operation makeRPT(frag_t frag, int count);
-Operation makeSFT(bool right, bool postSet, int size, int rpt,
-                  const std::vector<frag_t> &output);
-Operation makeSFI(bool right, bool postSet, bool preShift, int period, int rpt,
-                  const std::vector<frag_t> &output);
-Operation makeCPY(int offset, int length, bool byteReverse,
-                  const std::vector<frag_t> &output);
-Operation makeCPX(int offset, int length, uint8_t cpxFlags,
-                  const std::vector<frag_t> &output);
 
 }  // namespace mamefont::mamec
\ No newline at end of file
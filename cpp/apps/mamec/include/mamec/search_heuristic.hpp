@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+
+#include "mamec/cost_model.hpp"
+#include "mamec/mamec_common.hpp"
+
+namespace mamefont::mamec {
+
+enum class Heuristic {
+  NONE,
+  SIMPLE,
+  SUFFIX,
+};
+
+struct HeuristicParams {
+  Heuristic type = Heuristic::NONE;
+  mf::PixelFormat pixelFormat = mf::PixelFormat::BW_1BIT;
+  bool noCpx = false;
+  bool noSfi = false;
+  CostParams cost;
+  // Whether LUP can load the fragment at each position, i.e. the fragment
+  // table has a match for it. Empty if not known, taken as true.
+  std::vector<bool> lupLoadable;
+};
+
+// Returns a lower bound of the cost to encode fragments[pos..] for each
+// position, including the end of the glyph (always 0). The bound never
+// decreases by more than the cost of an operation that advances the
+// position, so the search can use it as a consistent A* heuristic.
+std::vector<int> estimateRemainingCosts(const HeuristicParams &params,
+                                        const std::vector<frag_t> &fragments,
+                                        const std::vector<frag_t> &compareMask);
+
+}  // namespace mamefont::mamec
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <map>
+#include <ostream>
+
+#include <stdint.h>
+
+#include "mamec/mamec_common.hpp"
+
+namespace mamefont::mamec {
+
+// Candidate generators of the glyph search, in the order they are called
+enum class Generator {
+  LUP,
+  XOR,
+  RPT,
+  SFT,
+  SFI,
+  CPY,
+  CPX,
+  COUNT,
+};
+
+const char *nameOf(Generator gen);
+
+// Where the operations of a glyph came from
+enum class SearchOrigin {
+  SEARCHED,
+  // Copied from a glyph with the same search input
+  REPEATED,
+  // Restored from the search cache
+  CACHED,
+};
+
+// Counters of a single glyph search. They are cheap enough to be collected
+// for every glyph.
+struct SearchStats {
+  int code = -1;
+  SearchOrigin origin = SearchOrigin::SEARCHED;
+  int numFrags = 0;
+  int numOperations = 0;
+  long statesCreated = 0;
+  long statesExpanded = 0;
+  long candidates[(int)Generator::COUNT] = {0};
+  size_t peakQueueSize = 0;
+  size_t arenaBytes = 0;
+  // The best-first search ran into MAX_SEARCH_STATES and the glyph was
+  // finished greedily from the state it had reached
+  bool stateCapped = false;
+  // Share of the cycles in the cost of the search that produced the
+  // operations, in percent, and how many searches with a smaller share ran
+  // out of the cycle budget before it
+  int speedWeight = 0;
+  int cycleRetries = 0;
+  long elapsedUs = 0;
+};
+
+// Writes the stats of all glyphs as JSON
+void writeSearchStats(const std::map<int, SearchStats> &stats,
+                      std::ostream &os);
+
+}  // namespace mamefont::mamec
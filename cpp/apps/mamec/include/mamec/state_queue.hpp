@@ -1,58 +1,203 @@
 #pragma once
 
+#include <algorithm>
+#include <functional>
 #include <map>
-#include <memory>
+#include <set>
+#include <stdexcept>
+#include <vector>
 
 #include "mamec/buffer_state.hpp"
 
 namespace mamefont::mamec {
 
-class StateQueue {
+enum class QueueBackend {
+  MAP,
+  BUCKET,
+};
+
+// Order of the states of the same priority. With a tight heuristic many
+// states share the priority of the solution, and taking the oldest first
+// expands that plateau breadth-first; the newest tend to be the deepest.
+enum class TieOrder {
+  OLDEST_FIRST,
+  NEWEST_FIRST,
+};
+
+// Orders state indices so that the first one is popped first
+struct TieCompare {
+  TieOrder order;
+
+  inline bool operator()(state_index_t a, state_index_t b) const {
+    return order == TieOrder::OLDEST_FIRST ? a < b : a > b;
+  }
+};
+
+// Priority queue of search states. States are popped in ascending order of
+// priority, and states with the same priority in the order of `tieOrder`.
+class MapStateQueue {
  public:
-  std::map<int, std::map<int, BufferState>> groups;
+  explicit MapStateQueue(TieOrder tieOrder = TieOrder::OLDEST_FIRST)
+      : tieCompare{tieOrder} {}
+
+  std::map<int, std::set<state_index_t, TieCompare>> groups;
 
   inline bool empty() const { return groups.empty(); }
+  inline size_t size() const { return numQueued; }
 
-  inline void put(BufferState state, int newCost) {
-    // remove state from the old cost group
-    int oldCost = state->bestCost;
-    if (groups.contains(oldCost)) {
-      auto &sameCostGroup = groups[oldCost];
-      if (sameCostGroup.contains(state->id)) {
-        if (newCost == oldCost) {
-          return;  // no change
-        }
-        sameCostGroup.erase(state->id);
-      }
-      if (sameCostGroup.empty()) {
-        groups.erase(oldCost);
-      }
+  inline void put(state_index_t state, int newPriority) {
+    if (state >= queuedPriority.size()) {
+      queuedPriority.resize(
+          std::max<size_t>(state + 1, queuedPriority.size() * 2), NOT_QUEUED);
     }
 
-    // update state cost
-    state->bestCost = newCost;
-
-    // add state to the new cost group
-    if (groups.contains(newCost)) {
-      groups[newCost][state->id] = state;
+    // remove state from the old priority group
+    int oldPriority = queuedPriority[state];
+    if (oldPriority == newPriority) {
+      return;  // no change
+    }
+    if (oldPriority == NOT_QUEUED) {
+      numQueued++;
     } else {
-      std::map<int, BufferState> newGroup;
-      newGroup[state->id] = state;
-      groups[newCost] = std::move(newGroup);
+      auto &samePriorityGroup = groups.find(oldPriority)->second;
+      samePriorityGroup.erase(state);
+      if (samePriorityGroup.empty()) {
+        groups.erase(oldPriority);
+      }
     }
+
+    // add state to the new priority group
+    queuedPriority[state] = newPriority;
+    groups.try_emplace(newPriority, tieCompare).first->second.insert(state);
   }
 
-  inline BufferState popBest() {
+  inline state_index_t popBest() {
     auto groupIt = groups.begin();
     auto &bestGroup = groupIt->second;
     auto bestIt = bestGroup.begin();
-    BufferState bestState = bestIt->second;
+    state_index_t bestState = *bestIt;
     bestGroup.erase(bestIt);
     if (bestGroup.empty()) {
       groups.erase(groupIt);
     }
+    queuedPriority[bestState] = NOT_QUEUED;
+    numQueued--;
     return bestState;
   }
+
+ private:
+  static constexpr int NOT_QUEUED = -1;
+
+  TieCompare tieCompare;
+  std::vector<int> queuedPriority;
+  size_t numQueued = 0;
+};
+
+// Monotone bucket queue (Dial's algorithm). Priorities are small integers and
+// a new priority is never lower than the one most recently popped, so each
+// priority maps directly to a slot of a circular bucket array that spans the
+// range of queued priorities. Each bucket is a small heap of state indices to
+// keep the same pop order as MapStateQueue.
+// Decreasing the priority of a queued state leaves a stale entry behind, which
+// is skipped when it reaches the top of its bucket.
+class BucketStateQueue {
+ public:
+  explicit BucketStateQueue(TieOrder tieOrder = TieOrder::OLDEST_FIRST)
+      : heapCompare{tieOrder == TieOrder::OLDEST_FIRST
+                        ? TieOrder::NEWEST_FIRST
+                        : TieOrder::OLDEST_FIRST} {
+    buckets.resize(INITIAL_NUM_BUCKETS);
+  }
+
+  inline bool empty() const { return numQueued == 0; }
+  inline size_t size() const { return numQueued; }
+
+  inline void put(state_index_t state, int newPriority) {
+    if (state >= queuedPriority.size()) {
+      queuedPriority.resize(
+          std::max<size_t>(state + 1, queuedPriority.size() * 2), NOT_QUEUED);
+    }
+
+    int oldPriority = queuedPriority[state];
+    if (oldPriority == newPriority) {
+      return;  // no change
+    }
+
+    if (newPriority < lastPopped) {
+      throw std::logic_error("Non-monotone priority in BucketStateQueue");
+    }
+    if (numQueued == 0) {
+      cursor = newPriority;
+      maxPriority = newPriority;
+    } else {
+      cursor = std::min(cursor, newPriority);
+      maxPriority = std::max(maxPriority, newPriority);
+      if (maxPriority - cursor >= (int)buckets.size()) {
+        grow(maxPriority - cursor + 1);
+      }
+    }
+
+    if (oldPriority == NOT_QUEUED) numQueued++;
+    queuedPriority[state] = newPriority;
+
+    auto &bucket = buckets[newPriority & (buckets.size() - 1)];
+    bucket.push_back(state);
+    std::push_heap(bucket.begin(), bucket.end(), heapCompare);
+  }
+
+  inline state_index_t popBest() {
+    while (true) {
+      auto &bucket = buckets[cursor & (buckets.size() - 1)];
+      while (!bucket.empty()) {
+        std::pop_heap(bucket.begin(), bucket.end(), heapCompare);
+        state_index_t state = bucket.back();
+        bucket.pop_back();
+        if (queuedPriority[state] == cursor) {
+          queuedPriority[state] = NOT_QUEUED;
+          numQueued--;
+          lastPopped = cursor;
+          return state;
+        }
+      }
+      cursor++;
+    }
+  }
+
+ private:
+  static constexpr int INITIAL_NUM_BUCKETS = 4096;
+  static constexpr int NOT_QUEUED = -1;
+
+  // The heaps put their largest element on top, so this is the reverse of
+  // the pop order
+  TieCompare heapCompare;
+  std::vector<std::vector<state_index_t>> buckets;
+  std::vector<int> queuedPriority;
+  size_t numQueued = 0;
+  int cursor = 0;
+  int maxPriority = 0;
+  int lastPopped = 0;
+
+  void grow(int minBuckets) {
+    size_t numBuckets = buckets.size();
+    while (numBuckets < (size_t)minBuckets) numBuckets *= 2;
+
+    std::vector<std::vector<state_index_t>> oldBuckets(numBuckets);
+    std::swap(buckets, oldBuckets);
+    for (auto &bucket : oldBuckets) {
+      for (state_index_t state : bucket) {
+        int priority = queuedPriority[state];
+        if (priority == NOT_QUEUED) continue;
+        auto &newBucket = buckets[priority & (numBuckets - 1)];
+        if (std::find(newBucket.begin(), newBucket.end(), state) ==
+            newBucket.end()) {
+          newBucket.push_back(state);
+        }
+      }
+    }
+    for (auto &bucket : buckets) {
+      std::make_heap(bucket.begin(), bucket.end(), heapCompare);
+    }
+  }
 };
 
-}  // namespace mamefont::mamec
\ No newline at end of file
+}  // namespace mamefont::mamec
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mamefont::mamec {
+
+// Records when the phases of the encoder start and end, and writes them in
+// the Chrome trace event format (chrome://tracing, Perfetto). Each thread
+// gets its own lane. Nothing is recorded until the tracer is enabled.
+class Tracer {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  static Tracer &instance();
+
+  // Starts recording. The calling thread becomes the main lane.
+  void enable();
+
+  inline bool enabled() const {
+    return enabledFlag.load(std::memory_order_relaxed);
+  }
+
+  void addEvent(const char *name, const std::string &detail,
+                Clock::time_point begin, Clock::time_point end);
+
+  void write(std::ostream &os) const;
+
+ private:
+  struct Event {
+    const char *name;
+    std::string detail;
+    long beginUs;
+    long durationUs;
+    int lane;
+  };
+
+  std::atomic<bool> enabledFlag = false;
+  Clock::time_point origin;
+  mutable std::mutex mutex;
+  std::vector<Event> events;
+  std::map<std::thread::id, int> laneOf;
+
+  int laneOfThisThread();
+};
+
+// Adds an event that spans the lifetime of the scope. `name` must outlive
+// the tracer, normally a string literal.
+class TraceScope {
+ public:
+  TraceScope(const char *name, std::string detail = "")
+      : name(name), active(Tracer::instance().enabled()) {
+    if (active) {
+      this->detail = std::move(detail);
+      begin = Tracer::Clock::now();
+    }
+  }
+
+  ~TraceScope() {
+    if (active) {
+      Tracer::instance().addEvent(name, detail, begin, Tracer::Clock::now());
+    }
+  }
+
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+ private:
+  const char *name;
+  std::string detail;
+  bool active;
+  Tracer::Clock::time_point begin;
+};
+
+}  // namespace mamefont::mamec
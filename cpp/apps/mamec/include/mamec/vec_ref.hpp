@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "mamec/mamec_common.hpp"
+#include "mamec/masked_compare.hpp"
 
 namespace mamefont::mamec {
 
@@ -93,12 +94,12 @@ static inline bool maskedEqual(const VecRef &a, const VecRef &b,
         ", b.size=" + std::to_string(b.size) +
         ", mask.size=" + std::to_string(mask.size));
   }
+  if (a.size == 0) return true;
   bool byteReverse = CPX::ByteReverse::read(cpxFlags);
-  for (size_t i = 0; i < a.size; ++i) {
-    int ia = byteReverse ? (a.size - 1 - i) : i;
-    if (!maskedEqual(a[ia], b[i], mask[i], cpxFlags, a.bpp)) return false;
-  }
-  return true;
+  const frag_t *src = &a.vector[a.start + (byteReverse ? a.size - 1 : 0)];
+  int n = a.size;
+  return maskedMatchLength(src, &b.vector[b.start], &mask.vector[mask.start],
+                           n, cpxFlags, a.bpp) == n;
 }
 
 void dumpByteArray(const std::vector<uint8_t> &arr, const std::string &indent,
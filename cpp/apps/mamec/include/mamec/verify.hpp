@@ -1,10 +1,13 @@
 #pragma once
 
+#include <vector>
+
 #include <mamefont/mamefont.hpp>
 #include "mamec/bitmap_font.hpp"
 
 namespace mamefont::mamec {
 
-bool verifyGlyphs(const BitmapFont &bmpFont, const mf::Font &mameFont, bool verbose = false, int verboseForCode = -1);
+bool verifyGlyphs(const BitmapFont &bmpFont, const std::vector<uint8_t> &blob, bool verbose = false, int verboseForCode = -1);
+bool verifyStream(const std::vector<uint8_t> &blob, bool verbose = false);
 
 }
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "mamec/mamec_common.hpp"
+
+namespace mamefont::mamec {
+
+// Worst-case decode cycles of a glyph, found by walking its byte code
+// without running it. The decoder takes the same path through the byte code
+// whatever the fragments are, so this is only as pessimistic as the cycle
+// table of the cost model.
+struct GlyphWcet {
+  int setupCycles = 0;
+  int instCycles = 0;
+  int numInsts = 0;
+
+  inline int cycles() const { return setupCycles + instCycles; }
+};
+
+// Analyzes every glyph defined in `blob`
+std::map<int, GlyphWcet> analyzeWcet(const std::vector<uint8_t> &blob);
+
+// Fragments of the ring buffer that decodeStream() needs for every glyph
+// defined in `blob`. The longest distance that a copy reads back is stored
+// in `maxCopyWindow`.
+int calcStreamBufferSize(const std::vector<uint8_t> &blob,
+                         int *maxCopyWindow = nullptr);
+
+// Whether any glyph defined in `blob` uses `op`
+bool usesOperator(const std::vector<uint8_t> &blob, mf::Operator op);
+
+// Lists the glyphs by their worst-case cycles, slowest first. Glyphs above
+// `maxCycles` are marked, unless it is 0. Returns the number of such glyphs.
+int reportWcet(const std::map<int, GlyphWcet> &wcet, int maxCycles,
+               std::ostream &os, const std::string &indent);
+
+}  // namespace mamefont::mamec
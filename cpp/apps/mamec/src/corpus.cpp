@@ -0,0 +1,58 @@
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include "mamec/corpus.hpp"
+
+namespace mamefont::mamec {
+
+CorpusCount loadCorpus(const std::string &path) {
+  std::ifstream ifs(path, std::ios::binary);
+  if (!ifs.is_open()) {
+    throw std::runtime_error("Failed to open corpus file: " + path);
+  }
+  std::string text((std::istreambuf_iterator<char>(ifs)),
+                   std::istreambuf_iterator<char>());
+
+  CorpusCount corpus;
+  size_t i = 0;
+  while (i < text.size()) {
+    uint8_t lead = text[i];
+    int numTrail = 0;
+    int code = lead;
+    if (lead >= 0xF0) {
+      numTrail = 3;
+      code = lead & 0x07;
+    } else if (lead >= 0xE0) {
+      numTrail = 2;
+      code = lead & 0x0F;
+    } else if (lead >= 0xC0) {
+      numTrail = 1;
+      code = lead & 0x1F;
+    } else if (lead >= 0x80) {
+      throw std::runtime_error("Invalid UTF-8 sequence in corpus file: " +
+                               path);
+    }
+    if (i + numTrail >= text.size()) {
+      throw std::runtime_error("Truncated UTF-8 sequence in corpus file: " +
+                               path);
+    }
+    for (int j = 1; j <= numTrail; j++) {
+      code = (code << 6) | (text[i + j] & 0x3F);
+    }
+    i += 1 + numTrail;
+    if (code == '\n' || code == '\r') continue;
+    corpus[code]++;
+  }
+  return corpus;
+}
+
+int corpusSize(const CorpusCount &corpus) {
+  int size = 0;
+  for (const auto &countPair : corpus) {
+    size += countPair.second;
+  }
+  return size;
+}
+
+}  // namespace mamefont::mamec
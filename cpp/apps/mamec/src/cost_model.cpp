@@ -0,0 +1,85 @@
+#include "mamec/cost_model.hpp"
+
+namespace mamefont::mamec {
+
+// Size cost per decoder cycle. A LUP costs about as much by either measure,
+// so BLEND trades them off evenly at 50%.
+static constexpr int CYCLE_COST = 50;
+
+// Under SPEED, the size cost divided by this breaks ties between operations
+// of the same cycles. It stays below CYCLE_COST for any operator.
+static constexpr int SIZE_TIE_BREAK_DIV = 100;
+
+// The figures follow the reference decoder built with avr-gcc -Os: the
+// opcode dispatch, the call into copyCore()/shiftCore() and their loops.
+DecodeCycles decodeCyclesOf(mf::Operator op, mf::PixelFormat bpp) {
+  bool bpp2 = bpp != mf::PixelFormat::BW_1BIT;
+  switch (op) {
+    case mf::Operator::LUP:
+      return {18, 6};
+    case mf::Operator::LUD:
+      return {20, 6};
+    case mf::Operator::LDI:
+      return {22, 4};
+    case mf::Operator::XOR:
+      return {24, 4};
+    case mf::Operator::RPT:
+      return {18, 4};
+    case mf::Operator::CPY:
+      return {40, 14};
+    case mf::Operator::CPX:
+      return {48, 14};
+    case mf::Operator::SFT:
+      // 2bpp fragments go through a 12-bit shift state
+      return bpp2 ? DecodeCycles{124, 68} : DecodeCycles{44, 18};
+    case mf::Operator::SFI:
+      return bpp2 ? DecodeCycles{130, 68} : DecodeCycles{50, 18};
+    default:
+      return {0, 0};
+  }
+}
+
+int estimateDecodeCycles(const OperationDesc &desc, mf::PixelFormat bpp) {
+  int cycles = estimateDecodeCycles(desc.op, 1, desc.outputLength, bpp);
+  if (desc.op == mf::Operator::CPX) {
+    uint8_t cpxFlags = desc.code[2];
+    int perFrag = 0;
+    if (mf::CPX::PixelReverse::read(cpxFlags)) {
+      perFrag += (bpp == mf::PixelFormat::BW_1BIT) ? 16 : 10;
+    }
+    if (mf::CPX::Inverse::read(cpxFlags)) {
+      perFrag += 1;
+    }
+    cycles += perFrag * desc.outputLength;
+  }
+  return cycles;
+}
+
+int estimateGlyphSetupCycles(int numFrags, bool clearsBuffer) {
+  // getGlyph() and the DecoderContext, then a store loop over the buffer
+  constexpr int SETUP_CYCLES = 120;
+  constexpr int CLEAR_CYCLES_PER_FRAG = 5;
+  return SETUP_CYCLES + (clearsBuffer ? CLEAR_CYCLES_PER_FRAG * numFrags : 0);
+}
+
+int CostParams::blend(int sizeCost, int cycles) const {
+  if (cyclesOnly) return cycles;
+  if (speedWeight <= 0) return sizeCost;
+  int speedCost = cycles * CYCLE_COST + sizeCost / SIZE_TIE_BREAK_DIV;
+  return ((100 - speedWeight) * sizeCost + speedWeight * speedCost) / 100;
+}
+
+int CostParams::costOf(const OperationDesc &desc) const {
+  if (speedWeight <= 0 && !cyclesOnly) return desc.cost;
+  return blend(desc.cost, estimateDecodeCycles(desc, pixelFormat));
+}
+
+int CostParams::minCostOf(mf::Operator op, int outputLength,
+                          int additionalCost) const {
+  int sizeCost = baseCostOf(op) + additionalCost;
+  if (speedWeight <= 0 && !cyclesOnly) return sizeCost;
+  return blend(sizeCost,
+               estimateDecodeCycles(op, 1, outputLength, pixelFormat));
+}
+
+}  // namespace mamefont::mamec
@@ -0,0 +1,267 @@
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include <nlohmann/json.hpp>
+
+#include "mamec/encode_cache.hpp"
+
+namespace mamefont::mamec {
+
+namespace fs = std::filesystem;
+
+// Barriers at either end of the glyph do not constrain the search; they only
+// decide the barrier flags, which are set again when operations are restored.
+static std::vector<int> innerBarriersOf(const GlyphObject &glyph) {
+  std::vector<int> barriers;
+  int numFrags = glyph->fragments.size();
+  for (const auto &barrierPair : glyph->barrierPosForSolveFragDup) {
+    if (0 < barrierPair.first && barrierPair.first < numFrags) {
+      barriers.push_back(barrierPair.first);
+    }
+  }
+  return barriers;
+}
+
+// Entries of the fragment table that LUP could load somewhere in the glyph,
+// in ascending order. The search only sees the table through these; their
+// indices do not change the choice of operations.
+static std::vector<frag_t> loadableFragsOf(
+    const GlyphObject &glyph, const std::vector<frag_t> &fragTable) {
+  std::vector<frag_t> loadable;
+  for (frag_t entry : fragTable) {
+    for (size_t pos = 0; pos < glyph->fragments.size(); pos++) {
+      frag_t diff = entry ^ glyph->fragments[pos];
+      if ((diff & glyph->compareMask[pos]) == 0) {
+        loadable.push_back(entry);
+        break;
+      }
+    }
+  }
+  std::sort(loadable.begin(), loadable.end());
+  loadable.erase(std::unique(loadable.begin(), loadable.end()),
+                 loadable.end());
+  return loadable;
+}
+
+struct Fnv1a {
+  uint64_t value = 0xCBF29CE484222325ull;
+
+  inline void add(uint8_t byte) {
+    value ^= byte;
+    value *= 0x100000001B3ull;
+  }
+
+  inline void add(const std::vector<frag_t> &bytes) {
+    add32(bytes.size());
+    for (frag_t byte : bytes) add(byte);
+  }
+
+  inline void add(const std::string &str) {
+    add32(str.size());
+    for (char c : str) add(c);
+  }
+
+  inline void add32(uint32_t word) {
+    for (int i = 0; i < 4; i++) add((word >> (i * 8)) & 0xFF);
+  }
+};
+
+void EncodeCache::setDirectory(const std::string &dir) {
+  fs::create_directories(dir);
+  directory = dir;
+}
+
+uint64_t EncodeCache::keyOf(const GlyphObject &glyph,
+                            const std::vector<frag_t> &fragTable) const {
+  Fnv1a hash;
+  hash.add32(ENCODER_VERSION);
+  hash.add(signature);
+  hash.add(glyph->fragments);
+  hash.add(glyph->compareMask);
+  std::vector<int> barriers = innerBarriersOf(glyph);
+  hash.add32(barriers.size());
+  for (int pos : barriers) hash.add32(pos);
+  hash.add32(glyph->speedWeight);
+  hash.add(loadableFragsOf(glyph, fragTable));
+  return hash.value;
+}
+
+bool EncodeCache::sameInput(const GlyphObject &a, const GlyphObject &b) {
+  return a->fragments == b->fragments && a->compareMask == b->compareMask &&
+         innerBarriersOf(a) == innerBarriersOf(b) &&
+         a->speedWeight == b->speedWeight;
+}
+
+const EncodeCache::Entry *EncodeCache::find(
+    uint64_t key, const GlyphObject &glyph,
+    const std::vector<frag_t> &loadableFrags) const {
+  auto it = entries.find(key);
+  if (it == entries.end()) return nullptr;
+  std::vector<int> barriers = innerBarriersOf(glyph);
+  for (const Entry &entry : it->second) {
+    if (entry.fragments == glyph->fragments &&
+        entry.compareMask == glyph->compareMask &&
+        entry.barriers == barriers &&
+        entry.speedWeight == glyph->speedWeight &&
+        entry.loadableFrags == loadableFrags) {
+      return &entry;
+    }
+  }
+  return nullptr;
+}
+
+bool EncodeCache::restore(GlyphObject &glyph,
+                          const std::vector<frag_t> &fragTable) {
+  uint64_t key = keyOf(glyph, fragTable);
+  std::vector<frag_t> loadableFrags = loadableFragsOf(glyph, fragTable);
+  const Entry *entry = find(key, glyph, loadableFrags);
+  if (!entry && loadFile(key)) {
+    entry = find(key, glyph, loadableFrags);
+  }
+  if (!entry) return false;
+
+  std::array<int, 256> indexOf;
+  indexOf.fill(-1);
+  for (int i = fragTable.size() - 1; i >= 0; i--) {
+    indexOf[fragTable[i]] = i;
+  }
+
+  const auto &barriers = glyph->barrierPosForSolveFragDup;
+  std::vector<Operation> oprs;
+  int pos = 0;
+  for (const auto &stored : entry->operations) {
+    Operation opr;
+    if (stored->op == mf::Operator::LUP) {
+      opr = makeLUP(indexOf[stored->output[0]], stored->output[0]);
+    } else {
+      opr = std::make_shared<OperationClass>(*stored);
+    }
+    int end = pos + opr->output.size();
+    opr->afterBarrier = barriers.count(pos) > 0;
+    opr->beforeBarrier = barriers.count(end) > 0;
+    oprs.push_back(opr);
+    pos = end;
+  }
+  glyph->operations = oprs;
+  return true;
+}
+
+void EncodeCache::store(const GlyphObject &glyph,
+                        const std::vector<frag_t> &fragTable) {
+  uint64_t key = keyOf(glyph, fragTable);
+  std::vector<frag_t> loadableFrags = loadableFragsOf(glyph, fragTable);
+  if (find(key, glyph, loadableFrags)) return;
+  auto &sameKey = entries[key];
+  sameKey.push_back(Entry{
+      glyph->fragments,
+      glyph->compareMask,
+      innerBarriersOf(glyph),
+      glyph->speedWeight,
+      loadableFrags,
+      glyph->operations,
+  });
+  numEntries++;
+  if (!directory.empty()) {
+    saveFile(key, sameKey.back());
+  }
+}
+
+std::string EncodeCache::pathOf(uint64_t key) const {
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.json", (unsigned long long)key);
+  return (fs::path(directory) / name).string();
+}
+
+// Reads the entry file for `key`. Files written for another encoder version
+// or signature, and files that cannot be parsed, are ignored.
+bool EncodeCache::loadFile(uint64_t key) {
+  if (directory.empty()) return false;
+  std::ifstream ifs(pathOf(key));
+  if (!ifs.is_open()) return false;
+  auto json = nlohmann::json::parse(ifs, nullptr, false);
+  if (json.is_discarded()) return false;
+
+  try {
+    if (json.at("version").get<int>() != ENCODER_VERSION) return false;
+    if (json.at("signature").get<std::string>() != signature) return false;
+
+    Entry entry;
+    json.at("fragments").get_to(entry.fragments);
+    json.at("compare_mask").get_to(entry.compareMask);
+    json.at("barriers").get_to(entry.barriers);
+    json.at("speed_weight").get_to(entry.speedWeight);
+    json.at("loadable_frags").get_to(entry.loadableFrags);
+    for (const auto &oprJson : json.at("operations")) {
+      std::vector<uint8_t> code = oprJson.at("code");
+      std::vector<frag_t> output = oprJson.at("output");
+      if (code.empty() || code.size() > 3 || output.empty()) return false;
+      int op = oprJson.at("op").get<int>();
+      if (op <= (int)mf::Operator::NONE || (int)mf::Operator::ABO <= op) {
+        return false;
+      }
+      OperationDesc desc;
+      desc.op = (mf::Operator)op;
+      if (code.size() != mf::instSizeOf(desc.op)) return false;
+      desc.codeLength = code.size();
+      for (size_t i = 0; i < 3; i++) {
+        desc.code[i] = i < code.size() ? code[i] : 0xFF;
+      }
+      desc.outputLength = output.size();
+      desc.cost = oprJson.at("cost").get<int>();
+      entry.operations.push_back(makeOperation(desc, output));
+    }
+    entries[key].push_back(entry);
+    numEntries++;
+    return true;
+  } catch (const std::exception &e) {
+    std::cerr << "*WARNING: Broken cache entry " << pathOf(key) << ": "
+              << e.what() << std::endl;
+    return false;
+  }
+}
+
+void EncodeCache::saveFile(uint64_t key, const Entry &entry) const {
+  nlohmann::json json;
+  json["version"] = ENCODER_VERSION;
+  json["signature"] = signature;
+  json["fragments"] = entry.fragments;
+  json["compare_mask"] = entry.compareMask;
+  json["barriers"] = entry.barriers;
+  json["speed_weight"] = entry.speedWeight;
+  json["loadable_frags"] = entry.loadableFrags;
+  json["operations"] = nlohmann::json::array();
+  for (const auto &opr : entry.operations) {
+    std::vector<uint8_t> code(opr->code, opr->code + opr->codeLength);
+    json["operations"].push_back({
+        {"op", (int)opr->op},
+        {"code", code},
+        {"cost", opr->cost},
+        {"output", opr->output},
+    });
+  }
+
+  // Written under a temporary name first so that a reader never sees a
+  // partially written file
+  std::string path = pathOf(key);
+  std::string tempPath = path + ".tmp";
+  {
+    std::ofstream ofs(tempPath);
+    if (!ofs.is_open()) {
+      std::cerr << "*WARNING: Failed to write cache entry " << path
+                << std::endl;
+      return;
+    }
+    ofs << json.dump() << std::endl;
+  }
+  std::error_code ec;
+  fs::rename(tempPath, path, ec);
+  if (ec) {
+    std::cerr << "*WARNING: Failed to write cache entry " << path << ": "
+              << ec.message() << std::endl;
+  }
+}
+
+}  // namespace mamefont::mamec
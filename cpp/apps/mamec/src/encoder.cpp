@@ -1,28 +1,75 @@
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <exception>
+#include <fstream>
 #include <iostream>
 #include <map>
 #include <memory>
-#include <stack>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include "mamec/bitmap_glyph.hpp"
 #include "mamec/buffer_state.hpp"
+#include "mamec/copy_history.hpp"
 #include "mamec/encoder.hpp"
 #include "mamec/glyph_object.hpp"
 #include "mamec/gray_bitmap.hpp"
+#include "mamec/lud_order.hpp"
+#include "mamec/search_heuristic.hpp"
 #include "mamec/state_queue.hpp"
+#include "mamec/trace.hpp"
 #include "mamec/vec_ref.hpp"
 
-#define FOR_FIELD_VALUES(field, value) \
-  for (int value = field::MIN; value <= field::MAX; value += field::STEP)
-
 namespace mamefont::mamec {
 
-static void dumpSearchTree(const BufferState &state, int *nodeCount, int length,
-                           int pos);
+// Number of candidates followed from each state with Effort::BALANCED
+static constexpr int BEAM_WIDTH = 4;
+
+// States a best-first search may create before it gives up on proving the
+// best solution and finishes greedily, about 40 MB of arena
+static constexpr size_t MAX_SEARCH_STATES = 1 << 19;
+
+// How much the share of the cycles in the cost is raised, in percent, each
+// time a glyph search runs out of its cycle budget
+static constexpr int RETRY_SPEED_WEIGHT_STEP = 25;
+
+// Lower cost per fragment first, then longer output first
+static inline bool moreEfficient(const OperationCandidate &a,
+                                 const OperationCandidate &b) {
+  long aCost = (long)a.desc.cost * b.desc.outputLength;
+  long bCost = (long)b.desc.cost * a.desc.outputLength;
+  if (aCost != bCost) return aCost < bCost;
+  return a.desc.outputLength > b.desc.outputLength;
+}
+
+// Stats of a glyph whose operations were not searched for
+static SearchStats restoredStats(const GlyphObject &glyph,
+                                 SearchOrigin origin) {
+  SearchStats stats;
+  stats.code = glyph->code;
+  stats.origin = origin;
+  stats.numFrags = glyph->fragments.size();
+  stats.numOperations = glyph->operations.size();
+  return stats;
+}
+
+// Completes the stats of a finished search
+static SearchStats finishStats(const SearchContext &search,
+                               const GlyphObject &glyph) {
+  SearchStats stats = search.stats;
+  stats.code = glyph->code;
+  stats.numFrags = glyph->fragments.size();
+  stats.numOperations = glyph->operations.size();
+  stats.statesCreated = search.arena.size();
+  stats.arenaBytes = search.arena.memoryUsage();
+  return stats;
+}
 
 void Encoder::addFont(const BitmapFont &bmpFont) {
+  TraceScope trace("addFont");
   if (options.verbose) {
     std::cout << "Adding font: " << bmpFont->familyName.c_str() << std::endl;
   }
@@ -195,6 +242,23 @@ void Encoder::addGlyph(const BitmapFont &bmpFont, const BitmapGlyph &bmpGlyph) {
 }
 
 void Encoder::encode() {
+  // Everything besides the glyph itself that the search result depends on
+  std::string &signature = searchCache.signature;
+  signature = "bpp=" + std::to_string((int)pixelFormat);
+  signature += ",cpx=" + std::to_string(!options.noCpx);
+  signature += ",sfi=" + std::to_string(!options.noSfi);
+  signature += ",queue=" + std::to_string((int)options.queueBackend);
+  signature += ",heuristic=" + std::to_string((int)options.heuristic);
+  signature += ",effort=" + std::to_string((int)options.effort);
+  signature += ",max_cycles=" + std::to_string(options.maxGlyphCycles);
+  if (!options.cacheDir.empty()) {
+    searchCache.setDirectory(options.cacheDir);
+  }
+
+  for (auto &glyphPair : glyphs) {
+    glyphPair.second->speedWeight = speedWeightOf(glyphPair.first);
+  }
+
   if (options.verbose) {
     std::cout << "Generating initial fragment table..." << std::endl;
   }
@@ -209,48 +273,161 @@ void Encoder::encode() {
   }
   detectFragmentDuplications("  ");
 
-  if (options.verbose) {
-    std::cout << "Encoding glyphs..." << std::endl;
+  int size = encodePass(1);
+  if (options.verbose && options.maxPasses > 1) {
+    std::cout << "Pass 1: " << size << " Bytes" << std::endl;
   }
-  for (auto &glyphPair : glyphs) {
-    GlyphObject &glyph = glyphPair.second;
+
+  // The glyphs were encoded against the initial table, which the table built
+  // from their operations has replaced. Encode them again against the new
+  // table for as long as that makes the result smaller.
+  for (int pass = 2; pass <= options.maxPasses; pass++) {
+    EncodeSnapshot last = snapshot();
+    int newSize = encodePass(pass);
     if (options.verbose) {
-      std::cout << "  Generating operations for " << c2s(glyph->code)
-                << std::endl;
+      std::cout << "Pass " << pass << ": " << newSize << " Bytes ("
+                << std::showpos << (newSize - size) << std::noshowpos
+                << " Bytes)" << std::endl;
     }
-    bool v = options.verbose && options.verboseForCode == glyph->code;
-    generateInitialOperations(glyph, v, "    ");
+    if (newSize >= size) {
+      restore(last);
+      if (options.verbose) {
+        std::cout << "  No longer shrinking, result of pass " << (pass - 1)
+                  << " kept." << std::endl;
+      }
+      break;
+    }
+    size = newSize;
+  }
+
+  if (!options.searchStatsPath.empty()) {
+    std::ofstream ofs(options.searchStatsPath);
+    if (!ofs.is_open()) {
+      throw std::runtime_error("Failed to open search stats file: " +
+                               options.searchStatsPath);
+    }
+    writeSearchStats(searchStats, ofs);
   }
 
   if (options.verbose) {
-    std::cout << "Regenerating fragment table..." << std::endl;
+    std::cout << "Encode finished." << std::endl;
   }
-  generateFullFragTable();
+}
+
+// Encodes all glyphs against the current fragment table, then builds the
+// table again from the operations. Returns encodedSize().
+int Encoder::encodePass(int pass) {
+  if (options.verbose && options.maxPasses > 1) {
+    std::cout << "Pass " << pass << ":" << std::endl;
+  }
+
   if (options.verbose) {
-    dumpByteArray(fragTable, "  ");
-    std::cout << "  (" << fragTable.size() << " entries)" << std::endl;
+    std::cout << "Encoding glyphs..." << std::endl;
   }
+  generateAllInitialOperations();
 
   if (options.verbose) {
-    std::cout << "Optimizing Fragment Table..." << std::endl;
+    std::cout << "Regenerating fragment table..." << std::endl;
   }
-  optimizeFragmentTable();
+  EncodeSnapshot searched = snapshot();
+  generateFullFragTable();
+  int numLUD = finishFragTable("count");
+  int size = encodedSize();
+
+  if (options.fragTableSelector == FragTableSelector::SIZE) {
+    // The table selected by size is not always smaller once the table is
+    // reordered for LUD, so both are tried and the smaller one is kept.
+    EncodeSnapshot byCount = snapshot();
+    int numLUDByCount = numLUD;
+    restore(searched);
+    generateFragTableBySize();
+    numLUD = finishFragTable("size");
+    int sizeBySize = encodedSize();
+    if (options.verbose) {
+      std::cout << "  Selected by count: " << size << " Bytes, by size: "
+                << sizeBySize << " Bytes (" << std::showpos
+                << (sizeBySize - size) << std::noshowpos << " Bytes)"
+                << std::endl;
+    }
+    if (sizeBySize < size) {
+      size = sizeBySize;
+    } else {
+      restore(byCount);
+      numLUD = numLUDByCount;
+    }
+  }
+
   if (options.verbose) {
     dumpByteArray(fragTable, "  ");
-    std::cout << "  (" << fragTable.size() << " entries)" << std::endl;
+    std::cout << "  (" << fragTable.size() << " entries, " << numLUD
+              << " LUD)" << std::endl;
   }
+  return size;
+}
 
+// Orders the table for LUD and replaces the operations with LUP/LUD where
+// possible. Returns the number of LUD generated.
+int Encoder::finishFragTable(const std::string &label) {
+  optimizeFragmentTable();
+  EncodeSnapshot grouped = snapshot();
+  int numLUDByGrouping = replaceLDItoLUP();
+  int sizeByGrouping = encodedSize();
+  EncodeSnapshot byGrouping = snapshot();
+
+  restore(grouped);
+  orderFragTableForLUD();
+  int numLUD = replaceLDItoLUP();
+  int size = encodedSize();
   if (options.verbose) {
-    std::cout << "Replacing LDI with LUP/LUD..." << std::endl;
+    std::cout << "  Table by " << label << ": " << numLUDByGrouping
+              << " LUD by grouping (" << sizeByGrouping << " Bytes), "
+              << numLUD << " LUD by path cover (" << size << " Bytes)"
+              << std::endl;
+  }
+  if (size > sizeByGrouping) {
+    restore(byGrouping);
+    numLUD = numLUDByGrouping;
   }
-  replaceLDItoLUP(options.verbose, "  ");
+  return numLUD;
+}
 
-  if (options.verbose) {
-    std::cout << "Encode finished." << std::endl;
+// Size of the fragment table and the byte code as generateBlob() lays them
+// out. The glyph table does not depend on the operations.
+int Encoder::encodedSize() const {
+  int size = std::max<int>(2, (fragTable.size() + 1) & ~1);
+  for (const auto &glyphPair : glyphs) {
+    const GlyphObject &glyph = glyphPair.second;
+    if (glyph->fragDupSrcCode >= 0) continue;
+    int glyphSize = 0;
+    for (const auto &opr : glyph->operations) {
+      glyphSize += opr->codeLength;
+    }
+    // Entry points of small fonts must be even
+    if (!mayBeLargeFormat) glyphSize = (glyphSize + 1) & ~1;
+    size += glyphSize;
+  }
+  return size;
+}
+
+EncodeSnapshot Encoder::snapshot() const {
+  EncodeSnapshot snap;
+  snap.fragTable = fragTable;
+  for (const auto &glyphPair : glyphs) {
+    snap.operations[glyphPair.first] = glyphPair.second->operations;
+  }
+  return snap;
+}
+
+void Encoder::restore(const EncodeSnapshot &snap) {
+  fragTable = snap.fragTable;
+  updateFragIndex();
+  for (auto &glyphPair : glyphs) {
+    glyphPair.second->operations = snap.operations.at(glyphPair.first);
   }
 }
 
 void Encoder::generateInitialFragTable() {
+  TraceScope trace("generateInitialFragTable");
   // count how many times each fragment is used in LDI operations
   std::map<frag_t, int> fragCountMap;
   for (const auto &glyphPair : glyphs) {
@@ -267,92 +444,561 @@ void Encoder::generateInitialFragTable() {
 }
 
 void Encoder::detectFragmentDuplications(std::string indent) {
-  std::map<int, std::map<int, bool>> dupTree;
-
-  // Find a glyph that is completely contained within the beginning of another
-  // glyph's fragment
+  TraceScope trace("detectFragmentDuplications");
+  // Only the last track of a glyph has a partial mask
+  auto exactSizeOf = [](const GlyphObject &glyph) {
+    const auto &mask = glyph->compareMask;
+    return std::find_if(mask.begin(), mask.end(),
+                        [](frag_t m) { return m != 0xFF; }) -
+           mask.begin();
+  };
+
+  // The glyphs sorted by their fragments. The glyphs beginning with the same
+  // fragments form a contiguous range, so that only they are compared.
+  std::vector<GlyphObject> sorted;
+  for (auto &glyphPair : glyphs) {
+    sorted.push_back(glyphPair.second);
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            [](const GlyphObject &a, const GlyphObject &b) {
+              return a->fragments < b->fragments;
+            });
+
+  // Glyphs of a single track have partial masks from their first fragment
+  // on, so they are looked up by their first fragments under the mask
+  // instead. The index is built for each mask that such glyphs have.
+  constexpr int MASKED_KEY_SIZE = 4;
+  using MaskedIndex = std::map<std::vector<frag_t>, std::vector<GlyphObject>>;
+  std::map<std::vector<frag_t>, MaskedIndex> maskedIndices;
+  auto maskedKeyOf = [](const GlyphObject &glyph,
+                        const std::vector<frag_t> &mask) {
+    std::vector<frag_t> key(mask.size());
+    for (size_t i = 0; i < mask.size(); i++) {
+      key[i] = glyph->fragments[i] & mask[i];
+    }
+    return key;
+  };
+
+  // Find the glyphs that completely contain each glyph at their beginning
+  std::map<int, std::vector<int>> sourcesOf;
   for (auto &thisPair : glyphs) {
     GlyphObject &thisGlyph = thisPair.second;
-    const VecRef thisFrags(thisGlyph->fragments, pixelFormat);
-    const VecRef thisMask(thisGlyph->compareMask, pixelFormat);
-    int thisSize = thisFrags.size;
+    const auto &thisFrags = thisGlyph->fragments;
+    const auto &thisMask = thisGlyph->compareMask;
+    int thisSize = thisFrags.size();
     int thisCode = thisGlyph->code;
 
-    int bestDupSrcCode = -1;
-    size_t bestDupSrcSize = 0;
-    for (auto &otherPair : glyphs) {
-      GlyphObject &otherGlyph = otherPair.second;
-      int otherSize = otherGlyph->fragments.size();
+    // Fragments up to the first partial mask must match exactly
+    int exactSize = exactSizeOf(thisGlyph);
+
+    auto compare = [&](const GlyphObject &otherGlyph) {
+      const auto &otherFrags = otherGlyph->fragments;
+      const auto &otherMask = otherGlyph->compareMask;
+      int otherSize = otherFrags.size();
       int otherCode = otherGlyph->code;
 
-      if (otherCode == thisCode) continue;
-      if (otherSize < thisSize) continue;
-      if (otherSize == thisSize && otherCode > thisCode) continue;
+      if (otherCode == thisCode) return;
+      if (otherSize < thisSize) return;
+      if (otherSize == thisSize && otherCode > thisCode) return;
+
+      // The rest must match under the mask of this glyph, and the other glyph
+      // must care about every pixel this glyph cares about
+      bool match = true;
+      for (int i = exactSize; i < thisSize && match; i++) {
+        match = ((thisFrags[i] ^ otherFrags[i]) & thisMask[i]) == 0;
+      }
+      for (int i = exactSizeOf(otherGlyph); i < thisSize && match; i++) {
+        match = (thisMask[i] & ~otherMask[i]) == 0;
+      }
+      if (match) {
+        sourcesOf[thisCode].push_back(otherCode);
+      }
+    };
+
+    if (exactSize == 0) {
+      int keySize = std::min(thisSize, MASKED_KEY_SIZE);
+      std::vector<frag_t> keyMask(thisMask.begin(),
+                                  thisMask.begin() + keySize);
+      if (!maskedIndices.contains(keyMask)) {
+        MaskedIndex &index = maskedIndices[keyMask];
+        for (const GlyphObject &glyph : sorted) {
+          if ((int)glyph->fragments.size() < keySize) continue;
+          index[maskedKeyOf(glyph, keyMask)].push_back(glyph);
+        }
+      }
+      const MaskedIndex &index = maskedIndices[keyMask];
+      auto it = index.find(maskedKeyOf(thisGlyph, keyMask));
+      if (it != index.end()) {
+        for (const GlyphObject &otherGlyph : it->second) compare(otherGlyph);
+      }
+      continue;
+    }
 
-      const VecRef otherFrags(otherGlyph->fragments, 0, thisSize, pixelFormat);
-      const VecRef otherMask(otherGlyph->compareMask, 0, thisSize, pixelFormat);
+    std::vector<frag_t> exactPart(thisFrags.begin(),
+                                  thisFrags.begin() + exactSize);
+    auto it = std::lower_bound(sorted.begin(), sorted.end(), exactPart,
+                               [](const GlyphObject &glyph,
+                                  const std::vector<frag_t> &frags) {
+                                 return glyph->fragments < frags;
+                               });
+    for (; it != sorted.end(); it++) {
+      const auto &otherFrags = (*it)->fragments;
+      if ((int)otherFrags.size() < exactSize ||
+          !std::equal(exactPart.begin(), exactPart.end(), otherFrags.begin())) {
+        break;
+      }
+      compare(*it);
+    }
+  }
 
-      if (!maskedEqual(thisFrags, otherFrags, thisMask)) {
-        continue;
+  // Being a prefix is transitive, so every glyph of a chain is a source of
+  // the glyphs before it, and a glyph can share the byte code of any root of
+  // a chain it belongs to directly. A root that already stops at the same
+  // position for another glyph is preferred, since every barrier constrains
+  // the search of the root. Otherwise the longest root is taken.
+  for (auto &thisPair : glyphs) {
+    GlyphObject &thisGlyph = thisPair.second;
+    int thisSize = thisGlyph->fragments.size();
+    int bestCode = -1;
+    bool bestFree = false;
+    for (int srcCode : sourcesOf[thisGlyph->code]) {
+      if (!sourcesOf[srcCode].empty()) continue;  // not a root
+      const GlyphObject &srcGlyph = glyphs[srcCode];
+      int srcSize = srcGlyph->fragments.size();
+      bool free = srcSize == thisSize ||
+                  srcGlyph->barrierPosForSolveFragDup.contains(thisSize);
+      bool better;
+      if (bestCode < 0 || free != bestFree) {
+        better = bestCode < 0 || free;
+      } else {
+        int bestSize = glyphs[bestCode]->fragments.size();
+        better = srcSize > bestSize ||
+                 (srcSize == bestSize && srcCode < bestCode);
       }
-      if (!maskedEqual(thisMask, otherMask, thisMask)) {
-        continue;
+      if (better) {
+        bestCode = srcCode;
+        bestFree = free;
       }
+    }
+    if (bestCode < 0) continue;
+
+    thisGlyph->fragDupSrcCode = bestCode;
+    glyphs[bestCode]->barrierPosForSolveFragDup[thisSize] = true;
+    if (options.verbose) {
+      std::cout << indent << "Fragment duplication found: "
+                << c2s(thisGlyph->code) << " --> " << c2s(bestCode)
+                << std::endl;
+    }
+  }
+}
 
-      if (otherSize > bestDupSrcSize) {
-        bestDupSrcSize = otherSize;
-        bestDupSrcCode = otherGlyph->code;
+void Encoder::generateAllInitialOperations() {
+  TraceScope trace("generateAllInitialOperations");
+  auto startTime = std::chrono::steady_clock::now();
+
+  // Glyphs that repeat the search input of an earlier glyph are not searched.
+  // They get a copy of its operations once the search is done.
+  std::vector<GlyphObject> jobs;
+  std::vector<GlyphObject> repeats;
+  std::map<uint64_t, std::vector<GlyphObject>> jobsByKey;
+  int numRestored = 0;
+  searchStats.clear();
+  for (auto &glyphPair : glyphs) {
+    GlyphObject &glyph = glyphPair.second;
+    if (searchCache.restore(glyph, fragTable)) {
+      numRestored++;
+      searchStats[glyph->code] = restoredStats(glyph, SearchOrigin::CACHED);
+      continue;
+    }
+    auto &sameKeyJobs = jobsByKey[searchCache.keyOf(glyph, fragTable)];
+    bool repeated = false;
+    for (const auto &job : sameKeyJobs) {
+      if (EncodeCache::sameInput(job, glyph)) {
+        repeated = true;
+        break;
       }
     }
+    if (repeated) {
+      repeats.push_back(glyph);
+    } else {
+      sameKeyJobs.push_back(glyph);
+      jobs.push_back(glyph);
+    }
+  }
+
+  int numThreads = options.numThreads;
+  if (numThreads <= 0) {
+    numThreads = std::thread::hardware_concurrency();
+  }
+  numThreads = std::max(1, std::min(numThreads, (int)jobs.size()));
+
+  // Each glyph is searched independently, so the resulting operations do not
+  // depend on which worker picks up which glyph.
+  std::atomic<size_t> nextJob = 0;
+  std::atomic<long> numExpanded = 0;
+  std::atomic<bool> aborted = false;
+  std::exception_ptr error = nullptr;
+  std::mutex mutex;
 
-    if (bestDupSrcCode >= 0) {
-      thisGlyph->fragDupSrcCode = bestDupSrcCode;
-      dupTree[bestDupSrcCode][thisCode] = true;
+  auto worker = [&]() {
+    while (!aborted) {
+      size_t iJob = nextJob++;
+      if (iJob >= jobs.size()) break;
+      GlyphObject &glyph = jobs[iJob];
+      if (options.verbose) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::cout << "  Generating operations for " << c2s(glyph->code)
+                  << std::endl;
+      }
+      try {
+        bool v = options.verbose && options.verboseForCode == glyph->code;
+        TraceScope trace("searchGlyph", c2s(glyph->code));
+        SearchStats stats = generateInitialOperations(glyph, v, "    ");
+        numExpanded += stats.statesExpanded;
+        std::lock_guard<std::mutex> lock(mutex);
+        searchStats[glyph->code] = stats;
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error) error = std::current_exception();
+        aborted = true;
+      }
+    }
+  };
+
+  if (numThreads <= 1) {
+    worker();
+  } else {
+    if (options.verbose) {
+      std::cout << "  Using " << numThreads << " threads." << std::endl;
+    }
+    std::vector<std::thread> threads;
+    for (int i = 0; i < numThreads; i++) {
+      threads.emplace_back(worker);
+    }
+    for (auto &thread : threads) {
+      thread.join();
     }
   }
 
-  // Resolve chained references
-  for (auto &rootPair : glyphs) {
-    GlyphObject &rootGlyph = rootPair.second;
-    if (rootGlyph->fragDupSrcCode >= 0) continue;
+  if (error) {
+    std::rethrow_exception(error);
+  }
 
-    std::stack<GlyphObject> stack;
-    stack.push(rootGlyph);
+  for (const auto &job : jobs) {
+    searchCache.store(job, fragTable);
+  }
+  for (auto &glyph : repeats) {
+    searchCache.restore(glyph, fragTable);
+    searchStats[glyph->code] = restoredStats(glyph, SearchOrigin::REPEATED);
+  }
 
-    while (!stack.empty()) {
-      GlyphObject &parentGlyph = stack.top();
-      stack.pop();
+  if (options.verbose) {
+    auto elapsed = std::chrono::steady_clock::now() - startTime;
+    auto elapsedMs =
+        std::chrono::duration_cast<std::chrono::milliseconds>(elapsed);
+    std::cout << "  Glyph search finished in " << elapsedMs.count() << " ms ("
+              << numExpanded << " states expanded)." << std::endl;
+    std::cout << "  " << jobs.size() << " glyphs searched, " << repeats.size()
+              << " repeated, " << numRestored << " restored from cache."
+              << std::endl;
+  }
+}
 
-      if (parentGlyph->fragDupSrcCode >= 0) {
-        parentGlyph->fragDupSrcCode = rootGlyph->code;
-        if (options.verbose) {
-          std::cout << indent
-                    << "Fragment duplication found: " << c2s(parentGlyph->code)
-                    << " --> " << c2s(rootGlyph->code) << std::endl;
+SearchStats Encoder::generateInitialOperations(GlyphObject &glyph,
+                                               bool verbose,
+                                               std::string indent) {
+  auto startTime = std::chrono::steady_clock::now();
+  auto search = [&](int speedWeight) {
+    switch (options.effort) {
+      case Effort::FAST:
+        return greedyOperations(glyph, speedWeight, verbose, indent);
+      default:
+        if (options.queueBackend == QueueBackend::MAP) {
+          return searchOperations<MapStateQueue>(glyph, speedWeight, verbose,
+                                                 indent);
+        } else {
+          return searchOperations<BucketStateQueue>(glyph, speedWeight,
+                                                    verbose, indent);
         }
+    }
+  };
+
+  // A path that favours size may run out of cycles where a faster one would
+  // not, so the share of the cycles in the cost is raised step by step before
+  // giving up. Each search is bounded by MAX_SEARCH_STATES, so are the retries.
+  int speedWeight = glyph->speedWeight;
+  int numRetries = 0;
+  SearchStats stats;
+  while (true) {
+    try {
+      stats = search(speedWeight);
+      break;
+    } catch (const CycleBoundError &e) {
+      if (speedWeight >= 100) throw std::runtime_error(e.what());
+    }
+    speedWeight = std::min(100, speedWeight + RETRY_SPEED_WEIGHT_STEP);
+    numRetries++;
+    if (verbose) {
+      std::cout << indent << "Out of cycles, retrying with speed weight "
+                << speedWeight << "%..." << std::endl;
+    }
+  }
+  stats.speedWeight = speedWeight;
+  stats.cycleRetries = numRetries;
+  auto elapsed = std::chrono::steady_clock::now() - startTime;
+  stats.elapsedUs =
+      std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+  return stats;
+}
+
+static std::string cycleBoundMessage(const GlyphObject &glyph,
+                                     const SearchContext &search,
+                                     int maxGlyphCycles) {
+  int setupCycles = maxGlyphCycles - search.maxCycles;
+  return "Glyph " + c2s(glyph->code) + " cannot be decoded within " +
+         std::to_string(maxGlyphCycles) + " cycles (estimated at least " +
+         std::to_string(setupCycles + search.minRemainingCycles[0]) + ")";
+}
+
+// Follows a single path, taking the candidate that looks cheapest at every
+// step and never going back. One state is expanded per operation.
+SearchStats Encoder::greedyOperations(GlyphObject &glyph, int speedWeight,
+                                      bool verbose, std::string indent) {
+  int numFrags = glyph->fragments.size();
+  SearchContext search;
+  BufferStateArena &arena = search.arena;
+
+  prepareSearch(search, glyph, speedWeight);
+
+  state_index_t first = arena.newRoot();
+  arena[first].bestCost = 0;
+
+  if (verbose) {
+    std::cout << indent << "Searching solution greedily..." << std::endl;
+  }
+  state_index_t goal = completeGreedily(search, glyph, first, 0);
+  storeOperations(glyph, arena, first, goal, indent);
+  return finishStats(search, glyph);
+}
+
+// Follows the cheapest looking candidates from `curr`, which took
+// `currCycles` to reach, to the end of the glyph. Returns the final state.
+state_index_t Encoder::completeGreedily(SearchContext &search,
+                                        const GlyphObject &glyph,
+                                        state_index_t curr, int currCycles) {
+  int numFrags = glyph->fragments.size();
+  BufferStateArena &arena = search.arena;
+  while (arena[curr].pos < numFrags) {
+    search.stats.statesExpanded++;
+    generateCandidates(search, glyph, curr);
+
+    auto &candidates = search.candidates;
+    if (search.maxCycles > 0) {
+      int currPos = arena[curr].pos;
+      auto overBudget = [&](const OperationCandidate &cand) {
+        int cycles = currCycles + estimateDecodeCycles(cand.desc, pixelFormat);
+        return !search.withinBudget(cycles,
+                                    currPos + cand.desc.outputLength);
+      };
+      candidates.erase(
+          std::remove_if(candidates.begin(), candidates.end(), overBudget),
+          candidates.end());
+      if (candidates.empty()) {
+        throw CycleBoundError(
+            cycleBoundMessage(glyph, search, options.maxGlyphCycles));
       }
+    }
+    auto best =
+        std::min_element(candidates.begin(), candidates.end(), moreEfficient);
+    if (best == candidates.end()) {
+      throw std::runtime_error("No solutions found for " + c2s(glyph->code));
+    }
+    currCycles += estimateDecodeCycles(best->desc, pixelFormat);
 
-      if (dupTree.contains(rootGlyph->code)) {
-        for (auto &childPair : dupTree[parentGlyph->code]) {
-          auto &childGlyph = glyphs[childPair.first];
-          stack.push(childGlyph);
-        }
+    const frag_t *output = &search.candidateOutput[best->outputStart];
+    state_index_t p = curr;
+    for (int i = 0; i < best->desc.outputLength; i++) {
+      p = arena.child(p, output[i]);
+    }
+    arena.setBestOperation(p, best->desc);
+    arena[p].bestPrev = curr;
+    arena[p].bestCost = arena[curr].bestCost + best->desc.cost;
+    curr = p;
+  }
+  return curr;
+}
+
+// With a corpus, the size saved by an encoding is traded for the cycles it
+// costs each time the glyph is drawn, so the weight of the cycles grows with
+// the frequency: a glyph as frequent as the average corpus character gets
+// 50%, the hot ones approach 100% and those not in the corpus get 0%.
+int Encoder::speedWeightOf(int code) const {
+  if (options.corpus.empty()) {
+    switch (options.costModel) {
+      case CostModel::SPEED:
+        return 100;
+      case CostModel::BLEND:
+        return options.speedWeight;
+      default:
+        return 0;
+    }
+  }
+
+  auto it = options.corpus.find(code);
+  if (it == options.corpus.end()) return 0;
+  long count = it->second;
+  long average = std::max(1L, (long)corpusSize(options.corpus) /
+                                  (long)options.corpus.size());
+  return (int)((100 * count + (count + average) / 2) / (count + average));
+}
+
+// Sets up the per-glyph tables shared by all states.
+void Encoder::prepareSearch(SearchContext &search, const GlyphObject &glyph,
+                            int speedWeight) {
+  int numFrags = glyph->fragments.size();
+
+  search.cost.model = options.costModel;
+  search.cost.pixelFormat = pixelFormat;
+  search.cost.speedWeight = speedWeight;
+
+  // Fragments that LUP/LDI can load at each position. They depend only on
+  // the position, so they are enumerated once instead of for every state.
+  search.loadCandidates.resize(numFrags);
+  for (int pos = 0; pos < numFrags; pos++) {
+    auto &candidates = search.loadCandidates[pos];
+    frag_t frag = glyph->fragments[pos];
+    frag_t dontCare = ~glyph->compareMask[pos];
+    frag_t diff = dontCare;
+    while (true) {
+      candidates.push_back(frag ^ diff);
+      if (diff == 0) break;
+      diff = (diff - 1) & dontCare;
+    }
+    std::sort(candidates.begin(), candidates.end());
+  }
+
+  // Whether LUP can load any of them with the current fragment table
+  search.lupLoadable.assign(numFrags, false);
+  for (int pos = 0; pos < numFrags; pos++) {
+    for (frag_t frag : search.loadCandidates[pos]) {
+      if (reverseLookup(frag) >= 0) {
+        search.lupLoadable[pos] = true;
+        break;
       }
     }
   }
 
-  for (auto &thisPair : glyphs) {
-    GlyphObject &thisGlyph = thisPair.second;
-    if (thisGlyph->fragDupSrcCode >= 0) {
-      glyphs[thisGlyph->fragDupSrcCode]
-          ->barrierPosForSolveFragDup[thisGlyph->fragments.size()] = true;
+  // The budget left for the instructions once the glyph is set up, and the
+  // fewest cycles that any encoding of the rest of the glyph takes
+  if (options.maxGlyphCycles > 0) {
+    search.maxCycles =
+        options.maxGlyphCycles -
+        estimateGlyphSetupCycles(numFrags,
+                                 glyph->useAltTop || glyph->useAltBottom);
+    HeuristicParams cyclesParams;
+    cyclesParams.type = Heuristic::SUFFIX;
+    cyclesParams.pixelFormat = pixelFormat;
+    cyclesParams.noCpx = options.noCpx;
+    cyclesParams.noSfi = options.noSfi;
+    cyclesParams.cost = search.cost;
+    cyclesParams.cost.cyclesOnly = true;
+    cyclesParams.lupLoadable = search.lupLoadable;
+    search.minRemainingCycles = estimateRemainingCosts(
+        cyclesParams, glyph->fragments, glyph->compareMask);
+    if (search.maxCycles < search.minRemainingCycles[0]) {
+      throw CycleBoundError(
+          cycleBoundMessage(glyph, search, options.maxGlyphCycles));
     }
   }
 }
 
-void Encoder::generateInitialOperations(GlyphObject &glyph, bool verbose,
-                                        std::string indent) {
+// Fills search.candidates with the operations that can follow `curr`. Those
+// that cross a barrier for fragment duplication are not included.
+void Encoder::generateCandidates(SearchContext &search,
+                                 const GlyphObject &glyph,
+                                 state_index_t curr) {
   int numFrags = glyph->fragments.size();
+  BufferStateArena &arena = search.arena;
+  int currPos = arena[curr].pos;
+
+  VecRef future(glyph->fragments, currPos, numFrags, pixelFormat);
+  VecRef mask(glyph->compareMask, currPos, numFrags, pixelFormat);
+
+  search.history.load(arena, curr);
+
+  search.candidates.clear();
+  search.candidateOutput.clear();
+  TryContext ctx{glyph->code, search, curr, arena[curr], future, mask};
+  static constexpr void (Encoder::*GENERATORS[])(TryContext) = {
+      &Encoder::tryLUP, &Encoder::tryXOR, &Encoder::tryRPT, &Encoder::trySFT,
+      &Encoder::trySFI, &Encoder::tryCPY, &Encoder::tryCPX,
+  };
+  static_assert(std::size(GENERATORS) == (size_t)Generator::COUNT);
+  for (int i = 0; i < (int)Generator::COUNT; i++) {
+    size_t numBefore = search.candidates.size();
+    (this->*GENERATORS[i])(ctx);
+    search.stats.candidates[i] += search.candidates.size() - numBefore;
+  }
+
+  if (glyph->barrierPosForSolveFragDup.empty()) return;
+
+  auto crossesBarrier = [&](const OperationCandidate &cand) {
+    for (auto &barrierPair : glyph->barrierPosForSolveFragDup) {
+      int barrierPos = barrierPair.first;
+      int outputStart = currPos;
+      int outputEnd = outputStart + cand.desc.outputLength;
+      if (outputStart < barrierPos && barrierPos < outputEnd) {
+        return true;
+      }
+    }
+    return false;
+  };
+  auto &candidates = search.candidates;
+  candidates.erase(
+      std::remove_if(candidates.begin(), candidates.end(), crossesBarrier),
+      candidates.end());
+}
+
+// Only the operations on the best path are materialized. Their output is
+// read back from the trie.
+void Encoder::storeOperations(GlyphObject &glyph,
+                              const BufferStateArena &arena,
+                              state_index_t first, state_index_t goal,
+                              std::string indent) {
+  const auto &barriers = glyph->barrierPosForSolveFragDup;
+  state_index_t p = goal;
+  std::vector<Operation> oprs;
+  std::vector<frag_t> output;
+  while (p != first) {
+    const OperationDesc &desc = arena.bestOperation(p);
+    state_index_t prev = arena[p].bestPrev;
+    output.resize(desc.outputLength);
+    arena.copyPastTo(p, output, desc.outputLength, desc.outputLength);
+    Operation opr = makeOperation(desc, output);
+    opr->afterBarrier = barriers.count(arena[prev].pos) > 0;
+    opr->beforeBarrier = barriers.count(arena[p].pos) > 0;
+    oprs.insert(oprs.begin(), opr);
+    p = prev;
+  }
+
+  if (options.verbose && options.verboseForCode == glyph->code) {
+    std::vector<uint8_t> byteCode;
+    for (const auto &opr : oprs) {
+      opr->writeCodeTo(byteCode);
+    }
+    std::cout << indent << oprs.size() << " operations, " << byteCode.size()
+              << " bytes generated." << std::endl;
+    dumpByteArray(byteCode, indent + "  ");
+  }
+
+  glyph->operations = oprs;
+}
+
+template <typename TQueue>
+SearchStats Encoder::searchOperations(GlyphObject &glyph, int speedWeight,
+                                      bool verbose, std::string indent) {
+  int numFrags = glyph->fragments.size();
+  SearchContext search;
 
   if (verbose) {
     std::cout << indent << "Fragments:" << std::endl;
@@ -364,97 +1010,124 @@ void Encoder::generateInitialOperations(GlyphObject &glyph, bool verbose,
   std::vector<std::vector<int>> scoreBoard(numFrags + 1,
                                            std::vector<int>(256, DUMMY_COST));
 
-  BufferState goalState = nullptr;
-
-  StateQueue waitList;
-  auto first = std::make_shared<BufferStateClass>(0, 0, nullptr);
-  waitList.put(first, 0);
-
-  int treeLeafCount[numFrags + 1] = {0};
-  char treeStateStr[numFrags + 2] = {' '};
-  treeStateStr[numFrags + 1] = '\0';
+  BufferStateArena &arena = search.arena;
+  state_index_t goalState = NO_STATE;
+
+  prepareSearch(search, glyph, speedWeight);
+  bool bounded = search.maxCycles > 0;
+
+  HeuristicParams heuristicParams;
+  heuristicParams.type = options.heuristic;
+  heuristicParams.pixelFormat = pixelFormat;
+  heuristicParams.noCpx = options.noCpx;
+  heuristicParams.noSfi = options.noSfi;
+  heuristicParams.cost = search.cost;
+  heuristicParams.lupLoadable = search.lupLoadable;
+  std::vector<int> remainingCost = estimateRemainingCosts(
+      heuristicParams, glyph->fragments, glyph->compareMask);
+
+  // With Effort::BALANCED only the most efficient candidates of each state
+  // are followed, which bounds the width of the search.
+  int beamWidth = (options.effort == Effort::BALANCED) ? BEAM_WIDTH : 0;
+
+  // Decoder cycles make the costs fine-grained enough for a tight heuristic,
+  // and the search then has to cut through a plateau of equal priorities.
+  // The size model keeps its order, which decides between its many
+  // solutions of the same size.
+  TQueue waitList(speedWeight > 0 ? TieOrder::NEWEST_FIRST
+                                  : TieOrder::OLDEST_FIRST);
+  state_index_t first = arena.newRoot();
+  arena[first].bestCost = 0;
+  waitList.put(first, remainingCost[0]);
+  if (bounded) search.bestCycles.assign(1, 0);
+
+  // Number of states at each position, for the verbose progress view. States
+  // are never removed, so only the ones created since the last update need
+  // to be counted.
+  std::vector<int> treeLeafCount(numFrags + 1, 0);
+  size_t numCountedStates = 0;
+  std::string treeStateStr(numFrags + 1, ' ');
 
   if (verbose) {
     std::cout << indent << "Searching solution..." << std::endl;
   }
+  SearchStats &stats = search.stats;
   while (!waitList.empty()) {
-    BufferState curr = waitList.popBest();
+    state_index_t curr = waitList.popBest();
+    int currPos = arena[curr].pos;
+    int currCost = arena[curr].bestCost;
+    stats.statesExpanded++;
 
-    if (curr->pos >= numFrags) {
-      if (curr->pos > numFrags) {
+    if (currPos >= numFrags) {
+      if (currPos > numFrags) {
         throw std::runtime_error("Search overrun");
       }
       goalState = curr;
       break;
     }
 
-    VecRef future(glyph->fragments, curr->pos, numFrags, pixelFormat);
-    VecRef mask(glyph->compareMask, curr->pos, numFrags, pixelFormat);
+    // The states popped last are the cheapest the search knows of, and the
+    // rest of the glyph is left to the greedy search
+    if (arena.size() >= MAX_SEARCH_STATES) {
+      if (verbose) {
+        std::cout << indent << "Too many states, finishing greedily..."
+                  << std::endl;
+      }
+      stats.stateCapped = true;
+      goalState = completeGreedily(search, glyph, curr,
+                                   bounded ? search.bestCycles[curr] : 0);
+      break;
+    }
 
-    std::vector<Operation> oprs;
-    TryContext ctx{glyph->code, oprs, curr, future, mask};
-    tryLUP(ctx);
-    tryXOR(ctx);
-    tryRPT(ctx);
-    trySFT(ctx);
-    trySFI(ctx);
-    tryCPY(ctx);
-    tryCPX(ctx);
+    generateCandidates(search, glyph, curr);
+    auto &candidates = search.candidates;
+    if (beamWidth > 0 && (int)candidates.size() > beamWidth) {
+      std::partial_sort(candidates.begin(), candidates.begin() + beamWidth,
+                        candidates.end(), moreEfficient);
+      candidates.resize(beamWidth);
+    }
 
     bool treeChanged = false;
-    for (const auto &opr : oprs) {
-#if 0
-      // todo delete checker code:
-      if (!maskedEqual(opr->output, future.slice(0, opr->output.size()),
-                       mask.slice(0, opr->output.size()))) {
-        throw std::runtime_error(
-            std::string("Operation ") + mf::mnemonicOf(opr->op) +
-            " generated fragments do not match future fragments for " +
-            c2s(glyph->code));
-      }
-#endif
+    for (const auto &cand : search.candidates) {
+      const OperationDesc &opr = cand.desc;
+      const frag_t *output = &search.candidateOutput[cand.outputStart];
 
-      // Reject operation that cross barriers for fragment duplication
-      bool barrierViolated = false;
-      for (auto &barrierPair : glyph->barrierPosForSolveFragDup) {
-        int barrierPos = barrierPair.first;
-        int outputStart = curr->pos;
-        int outputEnd = outputStart + opr->output.size();
-        if (outputStart < barrierPos && barrierPos < outputEnd) {
-          barrierViolated = true;
-          break;
-        }
-        opr->afterBarrier |= (outputStart == barrierPos);
-        opr->beforeBarrier |= (outputEnd == barrierPos);
+      state_index_t p = curr;
+      for (int i = 0; i < opr.outputLength; i++) {
+        p = arena.child(p, output[i]);
       }
-      if (barrierViolated) continue;
 
-      BufferState p = curr;
-      for (frag_t frag : opr->output) {
-        if (p->childState.contains(frag)) {
-          p = p->childState[frag];
-        } else {
-          auto newState =
-              std::make_shared<BufferStateClass>(p->pos + 1, frag, p);
-          p->childState[frag] = newState;
-          p = newState;
+      // Paths that cannot finish within the budget are dropped before they
+      // take part in the dominance check
+      int nextCycles = 0;
+      if (bounded) {
+        nextCycles =
+            search.bestCycles[curr] + estimateDecodeCycles(opr, pixelFormat);
+        if (!search.withinBudget(nextCycles, arena[p].pos)) continue;
+        if (search.bestCycles.size() < arena.size()) {
+          search.bestCycles.resize(arena.size(), 0);
         }
       }
 
-      int nextCost = curr->bestCost + opr->cost;
-      int otherCost = scoreBoard[p->pos][p->lastFrag];
-      if (nextCost < p->bestCost && nextCost <= otherCost) {
-        p->bestOpr = opr;
-        p->bestPrev = curr;
-        waitList.put(p, nextCost);
-        scoreBoard[p->pos][p->lastFrag] = nextCost;
+      BufferState &next = arena[p];
+      int nextCost = currCost + opr.cost;
+      int otherCost = scoreBoard[next.pos][next.lastFrag];
+      if (nextCost < next.bestCost && nextCost <= otherCost) {
+        arena.setBestOperation(p, opr);
+        next.bestPrev = curr;
+        next.bestCost = nextCost;
+        if (bounded) search.bestCycles[p] = nextCycles;
+        waitList.put(p, nextCost + remainingCost[next.pos]);
+        scoreBoard[next.pos][next.lastFrag] = nextCost;
         treeChanged = true;
       }
     }
+    stats.peakQueueSize = std::max(stats.peakQueueSize, waitList.size());
 
     if (treeChanged && verbose) {
-      memset(treeLeafCount, 0, sizeof(treeLeafCount));
-      dumpSearchTree(first, treeLeafCount, numFrags + 1, 0);
+      for (; numCountedStates < arena.size(); numCountedStates++) {
+        treeLeafCount[arena[numCountedStates].pos]++;
+      }
       bool strChanged = false;
       for (int i = 0; i < numFrags + 1; i++) {
         char c = '.';
@@ -474,45 +1147,28 @@ void Encoder::generateInitialOperations(GlyphObject &glyph, bool verbose,
     }
   }
 
-  if (!goalState) {
-    throw std::runtime_error("No solutions found for " + c2s(glyph->code));
-  }
-
-  BufferState p = goalState;
-  std::vector<Operation> oprs;
-  while (p->id != first->id) {
-    oprs.insert(oprs.begin(), p->bestOpr);
-    p = p->bestPrev;
-  }
-
-  if (options.verbose && options.verboseForCode == glyph->code) {
-    std::vector<uint8_t> byteCode;
-    for (const auto &opr : oprs) {
-      opr->writeCodeTo(byteCode);
+  if (goalState == NO_STATE) {
+    if (bounded) {
+      throw CycleBoundError(
+          cycleBoundMessage(glyph, search, options.maxGlyphCycles));
     }
-    std::cout << indent << oprs.size() << " operations, " << byteCode.size()
-              << " bytes generated." << std::endl;
-    dumpByteArray(byteCode, indent + "  ");
+    throw std::runtime_error("No solutions found for " + c2s(glyph->code));
   }
 
-  glyph->operations = oprs;
+  storeOperations(glyph, arena, first, goalState, indent);
+  return finishStats(search, glyph);
 }
 
 void Encoder::tryLUP(TryContext ctx) {
-  for (int frag = 0; frag <= 0xFF; frag++) {
-    if (maskedEqual(frag, ctx.future[0], ctx.compareMask[0])) {
-      int index = reverseLookup(frag);
-      if (index >= 0) {
-        ctx.oprs.push_back(makeLUP(index, frag));
-      } else {
-        if (ldiFrags.contains(frag)) {
-          ldiFrags[frag]++;
-        } else {
-          ldiFrags[frag] = 1;
-        }
-        int addCost = ldiFrags[frag] > 0 ? 1 : 0;
-        ctx.oprs.push_back(makeLDI(frag, addCost));
-      }
+  std::vector<frag_t> &output = ctx.search.candidateOutput;
+  for (frag_t frag : ctx.search.loadCandidates[ctx.state.pos]) {
+    int start = output.size();
+    output.push_back(frag);
+    int index = reverseLookup(frag);
+    if (index >= 0) {
+      ctx.search.addCandidate(describeLUP(index), start);
+    } else {
+      ctx.search.addCandidate(describeLDI(frag, 1), start);
     }
   }
 }
@@ -524,10 +1180,12 @@ void Encoder::tryXOR(TryContext ctx) {
       if (width2bit && pos == 7) continue;
 
       frag_t mask = (width2bit ? 0x03 : 0x01) << pos;
-      frag_t output = ctx.state->lastFrag ^ mask;
+      frag_t output = ctx.state.lastFrag ^ mask;
 
       if (maskedEqual(output, ctx.future[0], ctx.compareMask[0])) {
-        ctx.oprs.push_back(makeXOR(pos, width2bit, output));
+        ctx.search.addCandidate(describeXOR(pos, width2bit),
+                                ctx.search.candidateOutput.size());
+        ctx.search.candidateOutput.push_back(output);
         return;
       }
     }
@@ -537,19 +1195,23 @@ void Encoder::tryXOR(TryContext ctx) {
 void Encoder::tryRPT(TryContext ctx) {
   int rptMax = std::min((size_t)mf::RPT::RepeatCount::MAX, ctx.future.size);
   int rptStep = mf::RPT::RepeatCount::STEP;
-  frag_t lastFrag = ctx.state->lastFrag;
+  frag_t lastFrag = ctx.state.lastFrag;
+  // All repeat counts share one run of output fragments
+  std::vector<frag_t> &output = ctx.search.candidateOutput;
+  int start = output.size();
   for (int rpt = 1; rpt <= rptMax; rpt += rptStep) {
     if (!maskedEqual(lastFrag, ctx.future[rpt - 1], ctx.compareMask[rpt - 1])) {
       break;
     }
+    output.resize(start + rpt, lastFrag);
     if (rpt >= mf::RPT::RepeatCount::MIN) {
-      ctx.oprs.push_back(makeRPT(lastFrag, rpt));
+      ctx.search.addCandidate(describeRPT(rpt), start);
     }
   }
 }
 
 void Encoder::trySFT(TryContext ctx) {
-  frag_t last = ctx.state->lastFrag;
+  frag_t last = ctx.state.lastFrag;
   if (last == ctx.future[0]) {
     // If no shift is needed, return early
     return;
@@ -572,7 +1234,7 @@ void Encoder::trySFT(TryContext ctx) {
 void Encoder::trySFI(TryContext ctx) {
   if (options.noSfi) return;
 
-  frag_t last = ctx.state->lastFrag;
+  frag_t last = ctx.state.lastFrag;
   for (bool postSet : {false, true}) {
     if ((last == 0x00 && !postSet) || (last == 0xFF && postSet)) {
       // If the last fragment is all zeros or all ones, no shift can change it
@@ -600,7 +1262,9 @@ bool Encoder::tryShiftCore(TryContext ctx, bool isSFI, bool right, bool postSet,
     rptMax = std::min(rptMax, (int)ctx.future.size / period);
   }
 
-  std::vector<frag_t> output;
+  // Longer repeat counts extend the output of shorter ones
+  std::vector<frag_t> &output = ctx.search.candidateOutput;
+  int start = output.size();
 
   int stateWidth;
   switch (pixelFormat) {
@@ -620,7 +1284,7 @@ bool Encoder::tryShiftCore(TryContext ctx, bool isSFI, bool right, bool postSet,
   if (right) modifier <<= (stateWidth - size);
   if (!postSet) modifier = ~modifier;
 
-  frag_t workFrag = ctx.state->lastFrag;
+  frag_t workFrag = ctx.state.lastFrag;
   uint16_t state;
   switch (pixelFormat) {
     case mf::PixelFormat::BW_1BIT:
@@ -675,10 +1339,10 @@ bool Encoder::tryShiftCore(TryContext ctx, bool isSFI, bool right, bool postSet,
     }
     if (rpt >= rptMin && changeDetected) {
       if (isSFI) {
-        ctx.oprs.push_back(
-            makeSFI(right, postSet, preShift, period, rpt, output));
+        ctx.search.addCandidate(
+            describeSFI(right, postSet, preShift, period, rpt), start);
       } else {
-        ctx.oprs.push_back(makeSFT(right, postSet, size, rpt, output));
+        ctx.search.addCandidate(describeSFT(right, postSet, size, rpt), start);
       }
     }
   }
@@ -686,28 +1350,25 @@ bool Encoder::tryShiftCore(TryContext ctx, bool isSFI, bool right, bool postSet,
 }
 
 void Encoder::tryCPY(TryContext ctx) {
-  std::vector<frag_t> pastBuff;
-  const int pastLen = mf::CPY::Length::MAX + mf::CPY::Offset::MAX;
-  pastBuff.resize(pastLen);
-  ctx.state->copyPastTo(pastBuff, pastLen, pastLen);
+  const CopyHistory &history = ctx.search.history;
+  const int windowSize = CopyHistory::WINDOW_SIZE;
   FOR_FIELD_VALUES(mf::CPY::Length, length) {
     if (length > ctx.future.size) break;
     FOR_FIELD_VALUES(mf::CPY::Offset, offset) {
-      int iPastFrom = pastBuff.size() - offset - length;
-      int iPastTo = iPastFrom + length;
-      VecRef pastRef(pastBuff, iPastFrom, iPastTo, pixelFormat);
-      VecRef futureRef = ctx.future.slice(0, length);
-      VecRef maskRef = ctx.compareMask.slice(0, length);
-
+      int from = windowSize - offset - length;
       for (bool byteReverse : {false, true}) {
         // These combinations are reserved for other instructions
         if (!byteReverse && length == 1 && offset == 0) continue;
         if (byteReverse && length == 1) continue;
 
         uint8_t cpxFlags = mf::CPX::ByteReverse::place(byteReverse);
-        if (maskedEqual(pastRef, futureRef, maskRef, cpxFlags)) {
-          ctx.oprs.push_back(
-              makeCPY(offset, length, byteReverse, pastRef.toVector(cpxFlags)));
+        int anchor = byteReverse ? (from + length - 1) : from;
+        if (history.matchLength(anchor, cpxFlags, ctx.future, ctx.compareMask,
+                                length) == length) {
+          ctx.search.addCandidate(describeCPY(offset, length, byteReverse),
+                                  ctx.search.candidateOutput.size());
+          history.copyOut(from, length, cpxFlags, pixelFormat,
+                          ctx.search.candidateOutput);
           goto nextLength;
         }
       }
@@ -720,65 +1381,72 @@ void Encoder::tryCPY(TryContext ctx) {
 void Encoder::tryCPX(TryContext ctx) {
   if (options.noCpx) return;  // Skip CPX if disabled
 
-  std::vector<frag_t> pastBuff;
-  const int pastLen = mf::CPX::Offset::MAX;
-  pastBuff.resize(pastLen);
-  ctx.state->copyPastTo(pastBuff, pastLen, pastLen);
-
-  FOR_FIELD_VALUES(mf::CPX::Length, length) {
-    if (length > ctx.future.size) break;
+  const CopyHistory &history = ctx.search.history;
+  const int windowSize = CopyHistory::WINDOW_SIZE;
+  const int maxLength = std::min<int>(mf::CPX::Length::MAX, ctx.future.size);
+  if (maxLength < mf::CPX::Length::MIN) return;
 
-    VecRef futureRef = ctx.future.slice(0, length);
-    VecRef maskRef = ctx.compareMask.slice(0, length);
+  // Match length from each window position for each combination of flags,
+  // shared by all lengths. Flags are numbered in the order of the encoding.
+  std::vector<int8_t> &matchLengths = ctx.search.cpxMatchLength;
+  matchLengths.assign(8 * windowSize, -1);
 
-    bool found = false;
+  frag_t first = ctx.future[0];
+  frag_t dontCare = ~ctx.compareMask[0];
 
-    FOR_FIELD_VALUES(mf::CPX::Offset, offset) {
-      int iPastFrom = pastBuff.size() - offset;
-      int iPastTo = iPastFrom + length;
-      if (iPastTo > pastBuff.size()) continue;
-      if (iPastFrom < -length) break;
-
-      VecRef pastRef(pastBuff, iPastFrom, iPastTo, pixelFormat);
-
-      for (bool byteReverse : {false, true}) {
-        for (bool pixelReverse : {false, true}) {
-          for (bool inverse : {false, true}) {
-            uint8_t cpxFlags = 0;
-            cpxFlags |= mf::CPX::ByteReverse::place(byteReverse);
-            cpxFlags |= mf::CPX::PixelReverse::place(pixelReverse);
-            cpxFlags |= mf::CPX::Inverse::place(inverse);
-            if (maskedEqual(pastRef, futureRef, maskRef, cpxFlags)) {
-              ctx.oprs.push_back(makeCPX(offset, length, cpxFlags,
-                                         pastRef.toVector(cpxFlags)));
-              found = true;
-              goto nextLength;
-            }
+  FOR_FIELD_VALUES(mf::CPX::Length, length) {
+    if (length > maxLength) break;
+
+    // Only positions whose fragment can produce the first future fragment
+    // are visited, in the same order as a full scan: nearest offset first,
+    // then flags in ascending order.
+    int bestOffset = windowSize + 1;
+    uint8_t bestFlags = 0;
+    for (int order = 0; order < 8; order++) {
+      bool byteReverse = (order & 4) != 0;
+      bool pixelReverse = (order & 2) != 0;
+      bool inverse = (order & 1) != 0;
+      uint8_t cpxFlags = 0;
+      cpxFlags |= mf::CPX::ByteReverse::place(byteReverse);
+      cpxFlags |= mf::CPX::PixelReverse::place(pixelReverse);
+      cpxFlags |= mf::CPX::Inverse::place(inverse);
+
+      frag_t diff = dontCare;
+      while (true) {
+        frag_t src = first ^ diff;
+        if (inverse) src = ~src;
+        if (pixelReverse) src = mf::reversePixels(src, pixelFormat);
+        history.forEachPosition(src, [&](int pos) {
+          int from = byteReverse ? (pos - length + 1) : pos;
+          int offset = windowSize - from;
+          if (from < 0 || offset >= bestOffset) return false;
+          if (offset < length) return true;
+          int8_t &matchLength = matchLengths[order * windowSize + pos];
+          if (matchLength < 0) {
+            matchLength = history.matchLength(pos, cpxFlags, ctx.future,
+                                              ctx.compareMask, maxLength);
           }
-        }
+          if (matchLength < length) return true;
+          bestOffset = offset;
+          bestFlags = cpxFlags;
+          return false;
+        });
+        if (diff == 0) break;
+        diff = (diff - 1) & dontCare;
       }
     }
-  nextLength:
-    if (!found) return;
-  }
-}
+    if (bestOffset > windowSize) return;
 
-static void dumpSearchTree(const BufferState &state, int *nodeCount, int length,
-                           int pos) {
-#if 0
-  if (state->pos != pos || pos >= length) {
-    throw std::runtime_error("BufferState position mismatch: expected " +
-                             std::to_string(pos) + ", got " +
-                             std::to_string(state->pos));
-  }
-#endif
-  nodeCount[state->pos]++;
-  for (const auto &nextPair : state->childState) {
-    dumpSearchTree(nextPair.second, nodeCount, length, pos + 1);
+    int from = windowSize - bestOffset;
+    ctx.search.addCandidate(describeCPX(bestOffset, length, bestFlags),
+                            ctx.search.candidateOutput.size());
+    history.copyOut(from, length, bestFlags, pixelFormat,
+                    ctx.search.candidateOutput);
   }
 }
 
 void Encoder::generateFullFragTable() {
+  TraceScope trace("generateFullFragTable");
   // count how many times each fragment is used in LDI operations
   std::map<frag_t, int> fragCountMap;
   for (const auto &glyphPair : glyphs) {
@@ -817,9 +1485,124 @@ void Encoder::generateFragTableFromCountMap(std::map<frag_t, int> &countMap,
     fragTable.push_back(kv.second);
     if (++n >= tableSize) break;
   }
+  updateFragIndex();
+}
+
+// Chooses the table by the bytes it saves instead of by how often each
+// fragment is loaded. An operation that outputs a single fragment becomes a
+// LUP when the fragment is in the table, at the price of a byte of table.
+// Two adjacent LUPs may become a LUD, so fragments loaded next to each other
+// are worth more together; a pair that only pays off as a whole is found by
+// looking one fragment ahead once no single fragment pays off.
+void Encoder::generateFragTableBySize() {
+  TraceScope trace("generateFragTableBySize");
+  constexpr int TABLE_SLOT_COST = 1;
+
+  // Bytes saved by loading the fragments from the table, and the number of
+  // adjacent loads that could be merged into LUD
+  std::vector<int> saving(256, 0);
+  std::vector<std::vector<int>> pairCount(256, std::vector<int>(256, 0));
+  for (const auto &glyphPair : glyphs) {
+    const GlyphObject &glyph = glyphPair.second;
+    Operation prev = nullptr;
+    for (const auto &opr : glyph->operations) {
+      if (opr->output.size() != 1) {
+        prev = nullptr;
+        continue;
+      }
+      frag_t frag = opr->output[0];
+      int costWithout =
+          opr->op == mf::Operator::LUP ? mf::LDI::SIZE : opr->codeLength;
+      saving[frag] += costWithout - mf::LUP::SIZE;
+      if (prev && !prev->beforeBarrier && !opr->afterBarrier) {
+        frag_t prevFrag = prev->output[0];
+        pairCount[prevFrag][frag]++;
+        if (prevFrag != frag) pairCount[frag][prevFrag]++;
+        prev = nullptr;  // merged pairs do not overlap
+      } else {
+        prev = opr;
+      }
+    }
+  }
+
+  // Fragments that save nothing by themselves are left out. They would only
+  // be worth a slot for LUD, which depends on the order of the table and is
+  // not modeled well enough here.
+  std::vector<bool> isCandidate(256, false);
+  for (int frag = 0; frag < 256; frag++) {
+    isCandidate[frag] = saving[frag] > 0;
+  }
+
+  // Bytes saved by adding each fragment to the current selection
+  std::vector<bool> selected(256, false);
+  std::vector<int> gain(256);
+  for (int frag = 0; frag < 256; frag++) {
+    gain[frag] = saving[frag] + pairCount[frag][frag] - TABLE_SLOT_COST;
+  }
+
+  fragTable.clear();
+  auto select = [&](int frag) {
+    selected[frag] = true;
+    fragTable.push_back(frag);
+    for (int other = 0; other < 256; other++) {
+      if (other != frag) gain[other] += pairCount[other][frag];
+    }
+  };
+
+  while ((int)fragTable.size() < mf::MAX_FRAGMENT_TABLE_SIZE) {
+    int best = -1;
+    for (int frag = 0; frag < 256; frag++) {
+      if (!isCandidate[frag] || selected[frag]) continue;
+      if (best < 0 || gain[frag] > gain[best] ||
+          (gain[frag] == gain[best] && saving[frag] > saving[best])) {
+        best = frag;
+      }
+    }
+    if (best < 0) break;
+    if (gain[best] > 0) {
+      select(best);
+      continue;
+    }
+
+    // Lookahead: a pair of fragments that pays off only together
+    if ((int)fragTable.size() + 2 > mf::MAX_FRAGMENT_TABLE_SIZE) break;
+    int bestPairGain = 0;
+    int best1 = -1;
+    int best2 = -1;
+    for (int frag1 = 0; frag1 < 256; frag1++) {
+      if (!isCandidate[frag1] || selected[frag1]) continue;
+      for (int frag2 = frag1 + 1; frag2 < 256; frag2++) {
+        if (!isCandidate[frag2] || selected[frag2]) continue;
+        int pairGain = gain[frag1] + gain[frag2] + pairCount[frag1][frag2];
+        if (pairGain > bestPairGain) {
+          bestPairGain = pairGain;
+          best1 = frag1;
+          best2 = frag2;
+        }
+      }
+    }
+    if (best1 < 0) break;
+    select(best1);
+    select(best2);
+  }
+
+  // A fragment that breaks even costs nothing and may still form a LUD
+  while ((int)fragTable.size() < mf::MAX_FRAGMENT_TABLE_SIZE) {
+    int best = -1;
+    for (int frag = 0; frag < 256; frag++) {
+      if (!isCandidate[frag] || selected[frag] || gain[frag] < 0) continue;
+      if (best < 0 || gain[frag] > gain[best]) best = frag;
+    }
+    if (best < 0) break;
+    select(best);
+  }
+
+  updateFragIndex();
+  fixLUPIndex();
 }
 
 void Encoder::optimizeFragmentTable() {
+  TraceScope trace("optimizeFragmentTable");
   // Detecte frequent sequences of two fragments
   std::map<uint16_t, int> sequenceCountMap;
   for (auto frag1 : fragTable) {
@@ -873,7 +1656,7 @@ void Encoder::optimizeFragmentTable() {
         if (seq[0] == frag2) {
           if (n <= numFrozen) {
             // remove from Fragment Table
-            fragTable.erase(fragTable.begin() + frag2index);
+            eraseFragment(frag2index);
             seq.insert(seq.begin(), frag1);
             seqSize += 1;
           }
@@ -887,7 +1670,7 @@ void Encoder::optimizeFragmentTable() {
         if (seq.back() == frag1) {
           if (n <= numFrozen) {
             // remove from Fragment Table
-            fragTable.erase(fragTable.begin() + frag1index);
+            eraseFragment(frag1index);
             seq.push_back(frag2);
             seqSize += 1;
           }
@@ -896,12 +1679,12 @@ void Encoder::optimizeFragmentTable() {
       }
     } else if (frag1index >= 0 && frag2index >= 0) {
       if (frag1 == frag2) {
-        fragTable.erase(fragTable.begin() + frag1index);
+        eraseFragment(frag1index);
         sequences.push_back({frag1});
         seqSize += 1;
       } else {
-        fragTable.erase(fragTable.begin() + std::max(frag1index, frag2index));
-        fragTable.erase(fragTable.begin() + std::min(frag1index, frag2index));
+        eraseFragment(std::max(frag1index, frag2index));
+        eraseFragment(std::min(frag1index, frag2index));
         sequences.push_back({frag1, frag2});
         seqSize += 2;
       }
@@ -949,10 +1732,40 @@ void Encoder::optimizeFragmentTable() {
   }
   newTable.insert(newTable.end(), fragTable.begin(), fragTable.end());
   fragTable = std::move(newTable);
+  updateFragIndex();
 
   fixLUPIndex();
 }
 
+// Reorders the table with orderTableForLUD(). Only glyphs that have byte code
+// of their own are taken into account.
+void Encoder::orderFragTableForLUD() {
+  TraceScope trace("orderFragTableForLUD");
+  std::vector<LUPRun> runs;
+  for (const auto &glyphPair : glyphs) {
+    const GlyphObject &glyph = glyphPair.second;
+    if (glyph->fragDupSrcCode >= 0) continue;
+    LUPRun run;
+    Operation prev = nullptr;
+    for (const auto &opr : glyph->operations) {
+      bool loadable =
+          opr->output.size() == 1 && reverseLookup(opr->output[0]) >= 0;
+      bool separated = !prev || prev->beforeBarrier || opr->afterBarrier;
+      if (!loadable || separated) {
+        if (run.size() >= 2) runs.push_back(run);
+        run.clear();
+      }
+      if (loadable) run.push_back(opr->output[0]);
+      prev = loadable ? opr : nullptr;
+    }
+    if (run.size() >= 2) runs.push_back(run);
+  }
+
+  orderTableForLUD(fragTable, runs);
+  updateFragIndex();
+  fixLUPIndex();
+}
+
 void Encoder::fixLUPIndex() {
   // fix existing LUP operations
   for (auto &glyphPair : glyphs) {
@@ -975,7 +1788,8 @@ void Encoder::fixLUPIndex() {
   }
 }
 
-void Encoder::replaceLDItoLUP(bool verbose, std::string indent) {
+int Encoder::replaceLDItoLUP() {
+  TraceScope trace("replaceLDItoLUP");
   int numReplacedOps = 0;
   for (auto &glyphPair : glyphs) {
     GlyphObject &glyph = glyphPair.second;
@@ -1028,24 +1842,23 @@ void Encoder::replaceLDItoLUP(bool verbose, std::string indent) {
     }
   }
 
-  if (verbose) {
-    std::cout << indent << "Totally " << (numReplacedOps * 2)
-              << " instructions replaced with " << numReplacedOps << " LUD ."
-              << std::endl;
-  }
+  return numReplacedOps;
 }
 
-int Encoder::reverseLookup(frag_t frag) {
-  int n = fragTable.size();
-  for (int j = 0; j < n; j++) {
-    if (fragTable[j] == frag) {
-      return j;
-    }
+void Encoder::eraseFragment(int index) {
+  fragTable.erase(fragTable.begin() + index);
+  updateFragIndex();
+}
+
+void Encoder::updateFragIndex() {
+  fragIndex.fill(-1);
+  for (int i = fragTable.size() - 1; i >= 0; i--) {
+    fragIndex[fragTable[i]] = i;
   }
-  return -1;  // Not found
 }
 
 void Encoder::generateBlob() {
+  TraceScope trace("generateBlob");
   if (options.verbose) {
     std::cout << "Generating blob..." << std::endl;
   }
@@ -1084,12 +1897,30 @@ void Encoder::generateBlob() {
     }
   }
 
+  std::vector<int> codes;
+  for (const auto &glyphPair : glyphs) {
+    codes.push_back(glyphPair.first);
+  }
+  std::sort(codes.begin(), codes.end());
+  int firstCode = codes.front();
+  int lastCode = codes.back();
+
+  // Byte code is placed in code order, or hot glyphs first with a corpus
+  std::vector<int> placement = codes;
+  if (!options.corpus.empty()) {
+    auto countOf = [&](int code) {
+      auto it = options.corpus.find(code);
+      return it == options.corpus.end() ? 0 : it->second;
+    };
+    std::stable_sort(placement.begin(), placement.end(),
+                     [&](int a, int b) { return countOf(a) > countOf(b); });
+  }
+
   // Determine format of Glyph Table
   std::map<std::string, bool> largeFontReasons;
   std::map<std::string, bool> proportionalReasons;
   int lastWidth = -1;
   int lastXSpacing = -1;
-  int nextEntryPoint = 0;
   for (const auto &glyphPair : glyphs) {
     const GlyphObject &glyph = glyphPair.second;
 
@@ -1113,18 +1944,6 @@ void Encoder::generateBlob() {
       proportionalReasons["xStepBack"] = true;
     }
 
-    // Check entry point
-    if (glyph->fragDupSrcCode < 0) {
-      if (nextEntryPoint >= mf::SmallGlyphEntry::EntryPoint::MAX) {
-        largeFontReasons["entryPoint"] = true;
-      }
-      for (const auto &opr : glyph->operations) {
-        nextEntryPoint += opr->codeLength;
-      }
-      while (nextEntryPoint % 2 != 0) {
-        nextEntryPoint++;
-      }
-    }
     if (glyph->useAltTop || glyph->useAltBottom) {
       largeFontReasons["altTop/altBottom"] = true;
     }
@@ -1133,6 +1952,22 @@ void Encoder::generateBlob() {
     lastXSpacing = glyph->xSpaceOffset;
   }
 
+  // Check entry points
+  int nextEntryPoint = 0;
+  for (int code : placement) {
+    const GlyphObject &glyph = glyphs[code];
+    if (glyph->fragDupSrcCode >= 0) continue;
+    if (nextEntryPoint >= mf::SmallGlyphEntry::EntryPoint::MAX) {
+      largeFontReasons["entryPoint"] = true;
+    }
+    for (const auto &opr : glyph->operations) {
+      nextEntryPoint += opr->codeLength;
+    }
+    while (nextEntryPoint % 2 != 0) {
+      nextEntryPoint++;
+    }
+  }
+
   bool largeFont = largeFontReasons.size() > 0;
   bool proportional = proportionalReasons.size() > 0;
   if (options.verbose) {
@@ -1155,17 +1990,9 @@ void Encoder::generateBlob() {
     }
   }
 
-  std::vector<int> codes;
-  for (const auto &glyphPair : glyphs) {
-    codes.push_back(glyphPair.first);
-  }
-  std::sort(codes.begin(), codes.end());
-  int firstCode = codes.front();
-  int lastCode = codes.back();
-
   // Construct bytecode block and fix entry points
   std::vector<uint8_t> bytecodes;
-  for (int code : codes) {
+  for (int code : placement) {
     const GlyphObject &glyph = glyphs[code];
     if (glyph->fragDupSrcCode >= 0) {
       continue;
@@ -1174,7 +2001,7 @@ void Encoder::generateBlob() {
     for (const auto &opr : glyph->operations) {
       opr->writeCodeTo(bytecodes);
     }
-    if (!largeFont && code != lastCode) {
+    if (!largeFont && code != placement.back()) {
       while (bytecodes.size() % 2 != 0) {
         bytecodes.push_back(mf::baseCodeOf(mf::Operator::ABO));
       }
@@ -1193,6 +2020,23 @@ void Encoder::generateBlob() {
     bytecodes.push_back(mf::baseCodeOf(mf::Operator::ABO));
   }
 
+  if (options.verbose) {
+    // The byte code each duplicated glyph would have needed on its own
+    int numShared = 0;
+    int savedBytes = 0;
+    for (const auto &glyphPair : glyphs) {
+      const GlyphObject &glyph = glyphPair.second;
+      if (glyph->fragDupSrcCode < 0) continue;
+      numShared++;
+      for (const auto &opr : glyph->operations) {
+        savedBytes += opr->codeLength;
+      }
+    }
+    std::cout << "  " << numShared
+              << " glyphs share the byte code of another glyph, "
+              << savedBytes << " Bytes saved." << std::endl;
+  }
+
   // Solve fragment duplications
   for (const auto &glyphPair : glyphs) {
     const GlyphObject &thisGlyph = glyphPair.second;
@@ -1231,6 +2075,7 @@ void Encoder::generateBlob() {
     fragTable.push_back(0x00);
     dummyFragmentInserted = true;
   }
+  updateFragIndex();
   if (options.verbose && dummyFragmentInserted) {
     std::cout << "  Fragment Table size is odd or zero, adding a dummy entry."
               << std::endl;
@@ -3,15 +3,17 @@
 #include "mamec/file_type_cpp.hpp"
 #include "mamec/mamec_common.hpp"
 #include "mamec/metrics.hpp"
+#include "mamec/wcet.hpp"
 
 namespace mamefont::mamec {
 
 void exportHpp(std::ostream &os, const std::vector<uint8_t> &blob,
-               std::string name) {
+               std::string name, const CorpusCount &corpus,
+               const std::vector<uint8_t> &baselineBlob) {
   os << "#pragma once\n";
   os << "\n";
   os << "// Generated by mamec\n";
-  dumpMetrics(blob, os, "//   ");
+  dumpMetrics(blob, os, "//   ", corpus, baselineBlob);
 
   mf::Font mameFont(blob.data());
   int glyphTableOffset = mf::FontHeader::SIZE;
@@ -48,6 +50,10 @@ void exportHpp(std::ostream &os, const std::vector<uint8_t> &blob,
                          blob.size() - byteCodeOffset, true, false);
   os << "};\n";
   os << "\n";
+  os << "// Ring buffer size for mamefont::decodeStream()\n";
+  os << "const uint16_t " << name
+     << "_stream_buffer_size = " << calcStreamBufferSize(blob) << ";\n";
+  os << "\n";
   os << "#ifdef MAMEFONT_PROGMEM_SELF_DEFINED\n";
   os << "#undef MAMEFONT_PROGMEM\n";
   os << "#endif\n";
@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <array>
+#include <numeric>
+#include <vector>
+
+#include "mamec/lud_order.hpp"
+
+namespace mamefont::mamec {
+
+// Slots that can be the first or second fragment of a LUD
+static constexpr int NUM_LUD_SLOTS = mf::LUD::Index::MAX + 2;
+
+// Up to this many fragments, the best path over the pair counts is found by
+// dynamic programming over subsets
+static constexpr int MAX_EXACT_NODES = mf::LUD::Index::MAX + 1;
+
+static constexpr int MAX_LOCAL_SEARCH_ROUNDS = 32;
+
+using PairCount = std::vector<std::vector<int>>;
+
+static int countLUDWith(const std::array<int, 256> &indexOf,
+                        const std::vector<LUPRun> &runs) {
+  int numLUD = 0;
+  for (const auto &run : runs) {
+    int i = 0;
+    while (i + 1 < (int)run.size()) {
+      int index1 = indexOf[run[i]];
+      int index2 = indexOf[run[i + 1]];
+      int step = index2 - index1;
+      if (index1 >= 0 && index2 >= 0 && index1 <= mf::LUD::Index::MAX &&
+          (step == 0 || step == 1)) {
+        numLUD++;
+        i += 2;
+      } else {
+        i++;
+      }
+    }
+  }
+  return numLUD;
+}
+
+int countLUD(const std::vector<frag_t> &table,
+             const std::vector<LUPRun> &runs) {
+  std::array<int, 256> indexOf;
+  indexOf.fill(-1);
+  for (int i = table.size() - 1; i >= 0; i--) {
+    indexOf[table[i]] = i;
+  }
+  return countLUDWith(indexOf, runs);
+}
+
+// Puts `head` in front and the rest of `table` after it, in table order
+static std::vector<frag_t> withHead(const std::vector<frag_t> &table,
+                                    const std::vector<frag_t> &head) {
+  std::vector<bool> used(256, false);
+  std::vector<frag_t> order;
+  for (frag_t frag : head) {
+    used[frag] = true;
+    order.push_back(frag);
+  }
+  for (frag_t frag : table) {
+    if (!used[frag]) order.push_back(frag);
+  }
+  return order;
+}
+
+// Maximum-weight Hamiltonian path over `nodes`, by dynamic programming over
+// subsets (Held-Karp)
+static std::vector<frag_t> exactPath(const std::vector<frag_t> &nodes,
+                                     const PairCount &pairCount) {
+  int n = nodes.size();
+  if (n == 0) return {};
+  int numMasks = 1 << n;
+  std::vector<int> best(numMasks * n, -1);
+  std::vector<int8_t> from(numMasks * n, -1);
+  for (int v = 0; v < n; v++) {
+    best[(1 << v) * n + v] = 0;
+  }
+  for (int mask = 1; mask < numMasks; mask++) {
+    for (int v = 0; v < n; v++) {
+      int curr = best[mask * n + v];
+      if (curr < 0) continue;
+      for (int w = 0; w < n; w++) {
+        if (mask & (1 << w)) continue;
+        int next = (mask | (1 << w)) * n + w;
+        int weight = curr + pairCount[nodes[v]][nodes[w]];
+        if (weight > best[next]) {
+          best[next] = weight;
+          from[next] = v;
+        }
+      }
+    }
+  }
+
+  int mask = numMasks - 1;
+  int v = 0;
+  for (int w = 1; w < n; w++) {
+    if (best[mask * n + w] > best[mask * n + v]) v = w;
+  }
+  std::vector<frag_t> path;
+  while (v >= 0) {
+    path.push_back(nodes[v]);
+    int prev = from[mask * n + v];
+    mask &= ~(1 << v);
+    v = prev;
+  }
+  std::reverse(path.begin(), path.end());
+  return path;
+}
+
+// Links the most frequent pairs into chains, then puts the chains that
+// promise the most LUD first
+static std::vector<frag_t> greedyPath(const std::vector<frag_t> &nodes,
+                                      const PairCount &pairCount) {
+  struct Edge {
+    int count;
+    frag_t from;
+    frag_t to;
+  };
+  std::vector<Edge> edges;
+  for (frag_t a : nodes) {
+    for (frag_t b : nodes) {
+      if (a != b && pairCount[a][b] > 0) {
+        edges.push_back({pairCount[a][b], a, b});
+      }
+    }
+  }
+  std::stable_sort(
+      edges.begin(), edges.end(),
+      [](const Edge &a, const Edge &b) { return a.count > b.count; });
+
+  std::vector<int> next(256, -1);
+  std::vector<int> prev(256, -1);
+  std::vector<int> chainOf(256);
+  std::iota(chainOf.begin(), chainOf.end(), 0);
+  auto findChain = [&](int frag) {
+    while (chainOf[frag] != frag) {
+      frag = chainOf[frag] = chainOf[chainOf[frag]];
+    }
+    return frag;
+  };
+  for (const Edge &edge : edges) {
+    if (next[edge.from] >= 0 || prev[edge.to] >= 0) continue;
+    if (findChain(edge.from) == findChain(edge.to)) continue;
+    next[edge.from] = edge.to;
+    prev[edge.to] = edge.from;
+    chainOf[findChain(edge.from)] = findChain(edge.to);
+  }
+
+  std::vector<std::pair<int, std::vector<frag_t>>> chains;
+  for (frag_t head : nodes) {
+    if (prev[head] >= 0) continue;
+    int score = 0;
+    std::vector<frag_t> chain;
+    for (int frag = head; frag >= 0; frag = next[frag]) {
+      score += pairCount[frag][frag];
+      if (next[frag] >= 0) score += pairCount[frag][next[frag]];
+      chain.push_back(frag);
+    }
+    chains.push_back({score, chain});
+  }
+  std::stable_sort(
+      chains.begin(), chains.end(),
+      [](const auto &a, const auto &b) { return a.first > b.first; });
+
+  std::vector<frag_t> path;
+  for (const auto &chain : chains) {
+    path.insert(path.end(), chain.second.begin(), chain.second.end());
+  }
+  return path;
+}
+
+// Swaps a slot that can hold a LUD with any other slot, or moves a fragment
+// into such a slot, as long as that gives more LUD
+static void improveLocally(std::vector<frag_t> &order,
+                           const std::vector<LUPRun> &runs) {
+  int n = order.size();
+  int numSlots = std::min(n, NUM_LUD_SLOTS);
+  int bestCount = countLUD(order, runs);
+  for (int round = 0; round < MAX_LOCAL_SEARCH_ROUNDS; round++) {
+    bool improved = false;
+    for (int i = 0; i < numSlots; i++) {
+      for (int j = 0; j < n; j++) {
+        if (i == j) continue;
+        std::vector<frag_t> swapped = order;
+        std::swap(swapped[i], swapped[j]);
+        int count = countLUD(swapped, runs);
+        if (count > bestCount) {
+          order = std::move(swapped);
+          bestCount = count;
+          improved = true;
+          continue;
+        }
+
+        std::vector<frag_t> moved = order;
+        frag_t frag = moved[j];
+        moved.erase(moved.begin() + j);
+        moved.insert(moved.begin() + i, frag);
+        count = countLUD(moved, runs);
+        if (count > bestCount) {
+          order = std::move(moved);
+          bestCount = count;
+          improved = true;
+        }
+      }
+    }
+    if (!improved) break;
+  }
+}
+
+void orderTableForLUD(std::vector<frag_t> &table,
+                      const std::vector<LUPRun> &runs) {
+  PairCount pairCount(256, std::vector<int>(256, 0));
+  for (const auto &run : runs) {
+    for (int i = 0; i + 1 < (int)run.size(); i++) {
+      pairCount[run[i]][run[i + 1]]++;
+    }
+  }
+
+  // Fragments that take part in any pair, most frequent first
+  std::vector<int> weight(256, 0);
+  for (frag_t a : table) {
+    for (frag_t b : table) {
+      weight[a] += pairCount[a][b] + pairCount[b][a];
+    }
+  }
+  std::vector<frag_t> nodes;
+  for (frag_t frag : table) {
+    if (weight[frag] > 0) nodes.push_back(frag);
+  }
+  std::stable_sort(nodes.begin(), nodes.end(), [&](frag_t a, frag_t b) {
+    return weight[a] > weight[b];
+  });
+
+  std::vector<frag_t> path;
+  if ((int)nodes.size() <= MAX_EXACT_NODES) {
+    path = exactPath(nodes, pairCount);
+  } else {
+    path = greedyPath(nodes, pairCount);
+  }
+
+  std::vector<frag_t> order = withHead(table, path);
+  if (countLUD(order, runs) < countLUD(table, runs)) {
+    order = table;
+  }
+  improveLocally(order, runs);
+  table = std::move(order);
+}
+
+}  // namespace mamefont::mamec
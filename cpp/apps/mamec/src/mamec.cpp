@@ -18,22 +18,52 @@ static constexpr char OPT_INPUT = 'i';
 static constexpr char OPT_OUTPUT = 'o';
 static constexpr char OPT_ENCODING = 'e';
 static constexpr char OPT_VERIFY_ONLY = 'v';
+static constexpr char OPT_JOBS = 'j';
 static constexpr char OPT_NO_CPX = 0x82;
 static constexpr char OPT_NO_SFI = 0x83;
 static constexpr char OPT_FORCE_ZERO_PADDING = 0x84;
 static constexpr char OPT_VERBOSE = 0x85;
 static constexpr char OPT_SELF_TEST = 0x86;
+static constexpr char OPT_QUEUE = 0x87;
+static constexpr char OPT_HEURISTIC = 0x88;
+static constexpr char OPT_EFFORT = 0x89;
+static constexpr char OPT_EFFORT_GAP = 0x8A;
+static constexpr char OPT_CACHE_DIR = 0x8B;
+static constexpr char OPT_SEARCH_STATS = 0x8C;
+static constexpr char OPT_TRACE = 0x8D;
+static constexpr char OPT_MAX_PASSES = 0x8E;
+static constexpr char OPT_FRAG_TABLE = 0x8F;
+static constexpr char OPT_COST_MODEL = 0x90;
+static constexpr char OPT_SPEED_WEIGHT = 0x91;
+static constexpr char OPT_CORPUS = 0x92;
+static constexpr char OPT_MAX_GLYPH_CYCLES = 0x93;
+static constexpr char OPT_WCET = 0x94;
 
 static struct option long_opts[] = {
     {"input", required_argument, 0, OPT_INPUT},
     {"output", required_argument, 0, OPT_OUTPUT},
     {"encoding", required_argument, 0, OPT_ENCODING},
     {"verify_only", no_argument, 0, OPT_VERIFY_ONLY},
+    {"jobs", required_argument, 0, OPT_JOBS},
     {"no_cpx", no_argument, 0, OPT_NO_CPX},
     {"no_sfi", no_argument, 0, OPT_NO_SFI},
     {"force_zero_padding", no_argument, 0, OPT_FORCE_ZERO_PADDING},
     {"verbose", optional_argument, 0, OPT_VERBOSE},
     {"self_test", no_argument, 0, OPT_SELF_TEST},
+    {"queue", required_argument, 0, OPT_QUEUE},
+    {"heuristic", required_argument, 0, OPT_HEURISTIC},
+    {"effort", required_argument, 0, OPT_EFFORT},
+    {"effort_gap", no_argument, 0, OPT_EFFORT_GAP},
+    {"cache_dir", required_argument, 0, OPT_CACHE_DIR},
+    {"search_stats", required_argument, 0, OPT_SEARCH_STATS},
+    {"trace", required_argument, 0, OPT_TRACE},
+    {"max_passes", required_argument, 0, OPT_MAX_PASSES},
+    {"frag_table", required_argument, 0, OPT_FRAG_TABLE},
+    {"cost_model", required_argument, 0, OPT_COST_MODEL},
+    {"speed_weight", required_argument, 0, OPT_SPEED_WEIGHT},
+    {"corpus", required_argument, 0, OPT_CORPUS},
+    {"max_glyph_cycles", required_argument, 0, OPT_MAX_GLYPH_CYCLES},
+    {"wcet", no_argument, 0, OPT_WCET},
     {0, 0, 0, 0},
 };
 
@@ -49,10 +79,25 @@ int main(int argc, char *argv[]) {
   std::string argVerboseForCodeStr;
   int argVerboseForCode = -1;
   bool argSelfTest = false;
+  int argJobs = 1;
+  std::string argQueue("bucket");
+  std::string argHeuristic("suffix");
+  std::string argEffort("optimal");
+  bool argEffortGap = false;
+  std::string argCacheDir;
+  std::string argSearchStats;
+  std::string argTrace;
+  int argMaxPasses = 1;
+  std::string argFragTable("size");
+  std::string argCostModel("size");
+  int argSpeedWeight = 50;
+  std::string argCorpus;
+  int argMaxGlyphCycles = 0;
+  bool argWcet = false;
 
   char short_opts[256];
-  snprintf(short_opts, sizeof(short_opts), "%c:%c:%c:%c", OPT_INPUT, OPT_OUTPUT,
-           OPT_ENCODING, OPT_VERIFY_ONLY);
+  snprintf(short_opts, sizeof(short_opts), "%c:%c:%c:%c%c:", OPT_INPUT,
+           OPT_OUTPUT, OPT_ENCODING, OPT_VERIFY_ONLY, OPT_JOBS);
 
   int opt;
   while ((opt = getopt_long(argc, argv, short_opts, long_opts, NULL)) != -1) {
@@ -85,6 +130,88 @@ int main(int argc, char *argv[]) {
       case OPT_SELF_TEST:
         argSelfTest = true;
         break;
+      case OPT_JOBS:
+        // 0 means as many jobs as the hardware threads
+        try {
+          argJobs = std::stoi(optarg);
+        } catch (const std::exception &e) {
+          argJobs = -1;
+        }
+        if (argJobs < 0) {
+          std::cerr << "*ERROR: Invalid number of jobs: " << optarg
+                    << " (0 for auto)" << std::endl;
+          return 1;
+        }
+        break;
+      case OPT_QUEUE:
+        argQueue = optarg;
+        break;
+      case OPT_HEURISTIC:
+        argHeuristic = optarg;
+        break;
+      case OPT_EFFORT:
+        argEffort = optarg;
+        break;
+      case OPT_EFFORT_GAP:
+        argEffortGap = true;
+        break;
+      case OPT_CACHE_DIR:
+        argCacheDir = optarg;
+        break;
+      case OPT_SEARCH_STATS:
+        argSearchStats = optarg;
+        break;
+      case OPT_TRACE:
+        argTrace = optarg;
+        break;
+      case OPT_FRAG_TABLE:
+        argFragTable = optarg;
+        break;
+      case OPT_COST_MODEL:
+        argCostModel = optarg;
+        break;
+      case OPT_CORPUS:
+        argCorpus = optarg;
+        break;
+      case OPT_SPEED_WEIGHT:
+        try {
+          argSpeedWeight = std::stoi(optarg);
+        } catch (const std::exception &e) {
+          argSpeedWeight = -1;
+        }
+        if (argSpeedWeight < 0 || 100 < argSpeedWeight) {
+          std::cerr << "*ERROR: Invalid speed weight: " << optarg
+                    << " (0 to 100 percent)" << std::endl;
+          return 1;
+        }
+        break;
+      case OPT_MAX_GLYPH_CYCLES:
+        try {
+          argMaxGlyphCycles = std::stoi(optarg);
+        } catch (const std::exception &e) {
+          argMaxGlyphCycles = -1;
+        }
+        if (argMaxGlyphCycles <= 0) {
+          std::cerr << "*ERROR: Invalid number of cycles: " << optarg
+                    << std::endl;
+          return 1;
+        }
+        break;
+      case OPT_WCET:
+        argWcet = true;
+        break;
+      case OPT_MAX_PASSES:
+        try {
+          argMaxPasses = std::stoi(optarg);
+        } catch (const std::exception &e) {
+          argMaxPasses = 0;
+        }
+        if (argMaxPasses < 1) {
+          std::cerr << "*ERROR: Invalid number of passes: " << optarg
+                    << " (1 or more)" << std::endl;
+          return 1;
+        }
+        break;
       case '?':
         return 1;
     }
@@ -130,6 +257,67 @@ int main(int argc, char *argv[]) {
   options.forceZeroPadding = argForceZeroPadding;
   options.verbose = argVerbose;
   options.verboseForCode = argVerboseForCode;
+  options.numThreads = argJobs;
+  options.cacheDir = argCacheDir;
+  options.searchStatsPath = argSearchStats;
+  options.maxPasses = argMaxPasses;
+  if (argQueue == "map") {
+    options.queueBackend = QueueBackend::MAP;
+  } else if (argQueue == "bucket") {
+    options.queueBackend = QueueBackend::BUCKET;
+  } else {
+    fprintf(stderr, "Unknown queue backend: %s\n", argQueue.c_str());
+    return 1;
+  }
+  if (argHeuristic == "none") {
+    options.heuristic = Heuristic::NONE;
+  } else if (argHeuristic == "simple") {
+    options.heuristic = Heuristic::SIMPLE;
+  } else if (argHeuristic == "suffix") {
+    options.heuristic = Heuristic::SUFFIX;
+  } else {
+    fprintf(stderr, "Unknown heuristic: %s\n", argHeuristic.c_str());
+    return 1;
+  }
+  if (argFragTable == "count") {
+    options.fragTableSelector = FragTableSelector::COUNT;
+  } else if (argFragTable == "size") {
+    options.fragTableSelector = FragTableSelector::SIZE;
+  } else {
+    fprintf(stderr, "Unknown fragment table selector: %s\n",
+            argFragTable.c_str());
+    return 1;
+  }
+  if (argCostModel == "size") {
+    options.costModel = CostModel::SIZE;
+  } else if (argCostModel == "speed") {
+    options.costModel = CostModel::SPEED;
+  } else if (argCostModel == "blend") {
+    options.costModel = CostModel::BLEND;
+  } else {
+    fprintf(stderr, "Unknown cost model: %s\n", argCostModel.c_str());
+    return 1;
+  }
+  options.speedWeight = argSpeedWeight;
+  options.maxGlyphCycles = argMaxGlyphCycles;
+  if (!argCorpus.empty()) {
+    try {
+      options.corpus = loadCorpus(argCorpus);
+    } catch (const std::exception &e) {
+      std::cerr << "*ERROR: " << e.what() << std::endl;
+      return 1;
+    }
+  }
+  if (argEffort == "fast") {
+    options.effort = Effort::FAST;
+  } else if (argEffort == "balanced") {
+    options.effort = Effort::BALANCED;
+  } else if (argEffort == "optimal") {
+    options.effort = Effort::OPTIMAL;
+  } else {
+    fprintf(stderr, "Unknown effort: %s\n", argEffort.c_str());
+    return 1;
+  }
 
   if (options.verbose) {
     std::cout << "MameFont Encoder" << std::endl;
@@ -138,6 +326,36 @@ int main(int argc, char *argv[]) {
     std::cout << "  Encoding: " << argEncoding.c_str() << std::endl;
     std::cout << "  No CPX  : " << (argNoCPX ? "true" : "false") << std::endl;
     std::cout << "  No SFI  : " << (argNoSFI ? "true" : "false") << std::endl;
+    std::cout << "  Jobs    : " << argJobs << std::endl;
+    std::cout << "  Queue   : " << argQueue.c_str() << std::endl;
+    std::cout << "  Heuristic: " << argHeuristic.c_str() << std::endl;
+    std::cout << "  Effort  : " << argEffort.c_str() << std::endl;
+    std::cout << "  Passes  : " << argMaxPasses << std::endl;
+    std::cout << "  Frag Table: " << argFragTable.c_str() << std::endl;
+    std::cout << "  Cost    : " << argCostModel.c_str();
+    if (!options.corpus.empty()) {
+      std::cout << " (overridden by corpus)";
+    } else if (options.costModel == CostModel::BLEND) {
+      std::cout << " (speed " << argSpeedWeight << "%)";
+    }
+    std::cout << std::endl;
+    std::cout << "  Corpus  : "
+              << (argCorpus.empty() ? "(none)" : argCorpus.c_str());
+    if (!options.corpus.empty()) {
+      std::cout << " (" << corpusSize(options.corpus) << " chars)";
+    }
+    std::cout << std::endl;
+    std::cout << "  Max Cycles: ";
+    if (argMaxGlyphCycles > 0) {
+      std::cout << argMaxGlyphCycles << " per glyph";
+    } else {
+      std::cout << "(none)";
+    }
+    std::cout << std::endl;
+    std::cout << "  Cache   : "
+              << (argCacheDir.empty() ? "(none)" : argCacheDir.c_str())
+              << std::endl;
+    std::cout << "  SIMD    : " << maskedCompareKernelName() << std::endl;
   }
 
   if (argSelfTest) {
@@ -172,9 +390,14 @@ int main(int argc, char *argv[]) {
 
   std::string fontName;
   std::vector<uint8_t> blob;
+  std::vector<uint8_t> baselineBlob;
   std::shared_ptr<mf::Font> mameFont = nullptr;
   BitmapFont bmpFont = nullptr;
 
+  if (!argTrace.empty()) {
+    Tracer::instance().enable();
+  }
+
   bool success = true;
   try {
     if (options.verbose) {
@@ -183,8 +406,40 @@ int main(int argc, char *argv[]) {
 
     if (argInput.ends_with(".bmp") || argInput.ends_with(".png") ||
         argInput.ends_with(".jpg") || argInput.ends_with(".jpeg")) {
-      bmpFont = std::make_shared<BitmapFontClass>(argInput);
+      {
+        TraceScope trace("loadBitmapFont");
+        bmpFont = std::make_shared<BitmapFontClass>(argInput);
+      }
       fontName = importBitmapFont(bmpFont, blob, options);
+
+      if (!options.corpus.empty() && outputFileType == FileType::MAME_HPP) {
+        // Encode once more without the corpus to report what it gained
+        TraceScope trace("corpusBaseline");
+        EncodeOptions baselineOptions = options;
+        baselineOptions.corpus.clear();
+        baselineOptions.verbose = false;
+        baselineOptions.searchStatsPath.clear();
+        importBitmapFont(bmpFont, baselineBlob, baselineOptions);
+      }
+
+      if (argEffortGap) {
+        // Encode once more with the full search to see what was given up
+        std::vector<uint8_t> optimalBlob = blob;
+        if (options.effort != Effort::OPTIMAL) {
+          TraceScope trace("effortGap");
+          EncodeOptions optimalOptions = options;
+          optimalOptions.effort = Effort::OPTIMAL;
+          optimalOptions.verbose = false;
+          optimalOptions.searchStatsPath.clear();
+          importBitmapFont(bmpFont, optimalBlob, optimalOptions);
+        }
+        int gap = (int)blob.size() - (int)optimalBlob.size();
+        printf(
+            "Effort gap: %s %d Bytes, optimal %d Bytes (%+d Bytes, "
+            "%+.2f%%)\n",
+            argEffort.c_str(), (int)blob.size(), (int)optimalBlob.size(), gap,
+            100.0 * gap / optimalBlob.size());
+      }
     } else if (argInput.ends_with(".json")) {
       std::ifstream ifs(argInput);
       if (!ifs.is_open()) {
@@ -197,14 +452,38 @@ int main(int argc, char *argv[]) {
     }
 
     if (bmpFont) {
-      mf::Font mameFont(blob.data());
-      if (!verifyGlyphs(bmpFont, mameFont, options.verbose,
+      if (!verifyGlyphs(bmpFont, blob, options.verbose,
                         options.verboseForCode)) {
         throw std::runtime_error("Glyph verification failed");
       }
+      if (!verifyStream(blob, options.verbose)) {
+        throw std::runtime_error("Streaming decode verification failed");
+      }
+    }
+
+    if (argWcet || argMaxGlyphCycles > 0) {
+      // The search works on estimates of the operations before the fragment
+      // table is final, so the bound is checked again on the byte code
+      TraceScope trace("wcet");
+      auto wcet = analyzeWcet(blob);
+      int numViolations = 0;
+      if (argWcet) {
+        numViolations = reportWcet(wcet, argMaxGlyphCycles, std::cout, "");
+      } else {
+        for (const auto &wcetPair : wcet) {
+          if (wcetPair.second.cycles() > argMaxGlyphCycles) numViolations++;
+        }
+      }
+      if (numViolations > 0) {
+        throw std::runtime_error(std::to_string(numViolations) +
+                                 " glyphs exceed " +
+                                 std::to_string(argMaxGlyphCycles) +
+                                 " decode cycles");
+      }
     }
 
     if (!argVerifyOnly && success) {
+      TraceScope trace("export");
       switch (outputFileType) {
         case FileType::MAME_JSON: {
           std::ofstream ofs(argOutput);
@@ -214,7 +493,7 @@ int main(int argc, char *argv[]) {
 
         case FileType::MAME_HPP: {
           std::ofstream ofs(argOutput);
-          exportHpp(ofs, blob, fontName);
+          exportHpp(ofs, blob, fontName, options.corpus, baselineBlob);
           ofs.close();
         } break;
 
@@ -227,5 +506,16 @@ int main(int argc, char *argv[]) {
     std::cerr << "*ERROR: " << e.what() << std::endl;
   }
 
+  if (!argTrace.empty()) {
+    std::ofstream ofs(argTrace);
+    if (ofs.is_open()) {
+      Tracer::instance().write(ofs);
+    } else {
+      std::cerr << "*ERROR: Failed to open trace file: " << argTrace
+                << std::endl;
+      success = false;
+    }
+  }
+
   return success ? 0 : 1;
 }
@@ -7,8 +7,6 @@
 
 namespace mamefont::mamec {
 
-size_t objectId = 0;
-
 std::string i2s(int value, int width) {
   std::ostringstream oss;
   oss << std::setw(width) << value;
@@ -0,0 +1,173 @@
+#include "mamec/masked_compare.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    defined(__SSE2__)
+#define MAMEC_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace mamefont::mamec {
+
+int maskedMatchLengthScalar(const frag_t *src, const frag_t *dst,
+                            const frag_t *mask, int length, uint8_t cpxFlags,
+                            mf::PixelFormat bpp) {
+  int step = mf::CPX::ByteReverse::read(cpxFlags) ? -1 : 1;
+  for (int i = 0; i < length; i++) {
+    if (!maskedEqual(src[i * step], dst[i], mask[i], cpxFlags, bpp)) {
+      return i;
+    }
+  }
+  return length;
+}
+
+#ifdef MAMEC_X86_SIMD
+
+// SSE2 has no byte shuffle: swap the bytes of each word, then reverse the
+// words.
+static inline __m128i reverseBytesSSE2(__m128i v) {
+  v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+  v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+  v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+  return _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+}
+
+// Same swaps as mf::reversePixels(). The masks keep every bit inside its own
+// byte, so 16-bit shifts are safe.
+static inline __m128i swapBitsSSE2(__m128i v, int shift, char loMask) {
+  __m128i lo = _mm_and_si128(v, _mm_set1_epi8(loMask));
+  __m128i hi = _mm_andnot_si128(_mm_set1_epi8(loMask), v);
+  return _mm_or_si128(_mm_slli_epi16(lo, shift), _mm_srli_epi16(hi, shift));
+}
+
+static inline __m128i reversePixelsSSE2(__m128i v, mf::PixelFormat bpp) {
+  if (bpp == mf::PixelFormat::BW_1BIT) v = swapBitsSSE2(v, 1, 0x55);
+  v = swapBitsSSE2(v, 2, 0x33);
+  return swapBitsSSE2(v, 4, 0x0F);
+}
+
+static int maskedMatchLengthSSE2(const frag_t *src, const frag_t *dst,
+                                 const frag_t *mask, int length,
+                                 uint8_t cpxFlags, mf::PixelFormat bpp) {
+  bool byteReverse = mf::CPX::ByteReverse::read(cpxFlags);
+  bool pixelReverse = mf::CPX::PixelReverse::read(cpxFlags);
+  bool inverse = mf::CPX::Inverse::read(cpxFlags);
+  const __m128i zero = _mm_setzero_si128();
+
+  int i = 0;
+  for (; i + 16 <= length; i += 16) {
+    __m128i a;
+    if (byteReverse) {
+      a = reverseBytesSSE2(_mm_loadu_si128((const __m128i *)(src - i - 15)));
+    } else {
+      a = _mm_loadu_si128((const __m128i *)(src + i));
+    }
+    if (pixelReverse) a = reversePixelsSSE2(a, bpp);
+    if (inverse) a = _mm_xor_si128(a, _mm_set1_epi8(-1));
+    __m128i b = _mm_loadu_si128((const __m128i *)(dst + i));
+    __m128i m = _mm_loadu_si128((const __m128i *)(mask + i));
+    __m128i diff = _mm_and_si128(_mm_xor_si128(a, b), m);
+    int equal = _mm_movemask_epi8(_mm_cmpeq_epi8(diff, zero));
+    if (equal != 0xFFFF) return i + __builtin_ctz(~equal);
+  }
+
+  const frag_t *rest = byteReverse ? (src - i) : (src + i);
+  return i + maskedMatchLengthScalar(rest, dst + i, mask + i, length - i,
+                                     cpxFlags, bpp);
+}
+
+// Reverses the pixels of a nibble
+static constexpr char NIBBLE_REVERSE_1BPP[16] = {
+    0x0, 0x8, 0x4, 0xC, 0x2, 0xA, 0x6, 0xE,
+    0x1, 0x9, 0x5, 0xD, 0x3, 0xB, 0x7, 0xF,
+};
+static constexpr char NIBBLE_REVERSE_2BPP[16] = {
+    0x0, 0x4, 0x8, 0xC, 0x1, 0x5, 0x9, 0xD,
+    0x2, 0x6, 0xA, 0xE, 0x3, 0x7, 0xB, 0xF,
+};
+
+__attribute__((target("avx2"))) static int maskedMatchLengthAVX2(
+    const frag_t *src, const frag_t *dst, const frag_t *mask, int length,
+    uint8_t cpxFlags, mf::PixelFormat bpp) {
+  bool byteReverse = mf::CPX::ByteReverse::read(cpxFlags);
+  bool pixelReverse = mf::CPX::PixelReverse::read(cpxFlags);
+  bool inverse = mf::CPX::Inverse::read(cpxFlags);
+
+  const char *nibbleReverse = bpp == mf::PixelFormat::BW_1BIT
+                                  ? NIBBLE_REVERSE_1BPP
+                                  : NIBBLE_REVERSE_2BPP;
+  const __m256i lut = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128((const __m128i *)nibbleReverse));
+  const __m256i lowNibble = _mm256_set1_epi8(0x0F);
+  const __m256i reverseIndex = _mm256_setr_epi8(
+      15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,  //
+      15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+  const __m256i zero = _mm256_setzero_si256();
+
+  int i = 0;
+  for (; i + 32 <= length; i += 32) {
+    __m256i a;
+    if (byteReverse) {
+      a = _mm256_loadu_si256((const __m256i *)(src - i - 31));
+      a = _mm256_shuffle_epi8(a, reverseIndex);
+      a = _mm256_permute2x128_si256(a, a, 0x01);
+    } else {
+      a = _mm256_loadu_si256((const __m256i *)(src + i));
+    }
+    if (pixelReverse) {
+      __m256i lo = _mm256_and_si256(a, lowNibble);
+      __m256i hi = _mm256_and_si256(_mm256_srli_epi16(a, 4), lowNibble);
+      a = _mm256_or_si256(_mm256_slli_epi16(_mm256_shuffle_epi8(lut, lo), 4),
+                          _mm256_shuffle_epi8(lut, hi));
+    }
+    if (inverse) a = _mm256_xor_si256(a, _mm256_set1_epi8(-1));
+    __m256i b = _mm256_loadu_si256((const __m256i *)(dst + i));
+    __m256i m = _mm256_loadu_si256((const __m256i *)(mask + i));
+    __m256i diff = _mm256_and_si256(_mm256_xor_si256(a, b), m);
+    uint32_t equal = _mm256_movemask_epi8(_mm256_cmpeq_epi8(diff, zero));
+    if (equal != 0xFFFFFFFF) return i + __builtin_ctz(~equal);
+  }
+
+  const frag_t *rest = byteReverse ? (src - i) : (src + i);
+  return i + maskedMatchLengthSSE2(rest, dst + i, mask + i, length - i,
+                                   cpxFlags, bpp);
+}
+
+#endif
+
+using MatchLengthKernel = int (*)(const frag_t *, const frag_t *,
+                                  const frag_t *, int, uint8_t,
+                                  mf::PixelFormat);
+
+struct MatchLengthImpl {
+  MatchLengthKernel kernel;
+  const char *name;
+};
+
+static MatchLengthImpl selectKernel() {
+#ifdef MAMEC_X86_SIMD
+  if (__builtin_cpu_supports("avx2")) {
+    return {maskedMatchLengthAVX2, "AVX2"};
+  }
+  return {maskedMatchLengthSSE2, "SSE2"};
+#else
+  return {maskedMatchLengthScalar, "scalar"};
+#endif
+}
+
+static const MatchLengthImpl &impl() {
+  static const MatchLengthImpl selected = selectKernel();
+  return selected;
+}
+
+int maskedMatchLength(const frag_t *src, const frag_t *dst, const frag_t *mask,
+                      int length, uint8_t cpxFlags, mf::PixelFormat bpp) {
+  // Vectors do not pay off for a few fragments
+  if (length < 16) {
+    return maskedMatchLengthScalar(src, dst, mask, length, cpxFlags, bpp);
+  }
+  return impl().kernel(src, dst, mask, length, cpxFlags, bpp);
+}
+
+const char *maskedCompareKernelName() { return impl().name; }
+
+}  // namespace mamefont::mamec
@@ -3,6 +3,7 @@
 #include <iostream>
 
 #include "mamec/metrics.hpp"
+#include "mamec/wcet.hpp"
 
 namespace mamefont::mamec {
 
@@ -16,8 +17,33 @@ static std::string compPerf(std::string label, int genFrags, int numInsts,
   return oss.str();
 }
 
+static std::map<int, int> estimateCyclesPerGlyph(
+    const std::vector<uint8_t> &blob) {
+  std::map<int, int> cyclesPerGlyph;
+  for (const auto &wcetPair : analyzeWcet(blob)) {
+    cyclesPerGlyph[wcetPair.first] = wcetPair.second.cycles();
+  }
+  return cyclesPerGlyph;
+}
+
+// Decode cycles per character of `corpus`, counting only the characters
+// that the font has
+static float expectedCyclesPerChar(const std::map<int, int> &cyclesPerGlyph,
+                                   const CorpusCount &corpus) {
+  long totalCycles = 0;
+  long numChars = 0;
+  for (const auto &countPair : corpus) {
+    auto it = cyclesPerGlyph.find(countPair.first);
+    if (it == cyclesPerGlyph.end()) continue;
+    totalCycles += (long)it->second * countPair.second;
+    numChars += countPair.second;
+  }
+  return numChars == 0 ? 0.0f : (float)totalCycles / numChars;
+}
+
 void dumpMetrics(const std::vector<uint8_t> &blob, std::ostream &os,
-                 const std::string &indent) {
+                 const std::string &indent, const CorpusCount &corpus,
+                 const std::vector<uint8_t> &baselineBlob) {
   mf::Status ret;
   const mf::Font font(blob.data());
 
@@ -127,6 +153,9 @@ void dumpMetrics(const std::vector<uint8_t> &blob, std::ostream &os,
       font.farPixelFirst() ? "Far Pixel First" : "Near Pixel First";
   int bpp = mf::getBitsPerPixel(font.fragFormat());
 
+  int copyWindow;
+  int streamBuffSize = calcStreamBufferSize(blob, &copyWindow);
+
   // Generated by MameFont
   // clang-format off
   os << indent << "Format Version: " << (int)font.formatVersion() << "\n";
@@ -163,7 +192,63 @@ void dumpMetrics(const std::vector<uint8_t> &blob, std::ostream &os,
   os << indent << "  No Ref (ABO)        : " << i2s(numABO, 3) << " Bytes\n";
   os << indent << "  No Ref (Unexpected) : " << i2s(numUnexpNoRefs, 3) << " Bytes\n";
   os << indent << "Memory Efficiency: " << f2s(memEff, 6, 3) << " px/Byte\n";
+  os << indent << "Decoder Buffer:\n";
+  os << indent << "  Glyph Buffer  : " << i2s(font.calcMaxGlyphBufferSize(), 4) << " Bytes\n";
+  os << indent << "  Stream Buffer : " << i2s(streamBuffSize, 4) << " Bytes (copy window: " << copyWindow << " frags)\n";
   // clang-format on
+
+  std::map<int, int> cyclesPerGlyph = estimateCyclesPerGlyph(blob);
+  if (cyclesPerGlyph.empty()) return;
+  int totalCycles = 0;
+  for (const auto &cyclesPair : cyclesPerGlyph) {
+    totalCycles += cyclesPair.second;
+  }
+  auto slowest = std::max_element(
+      cyclesPerGlyph.begin(), cyclesPerGlyph.end(),
+      [](const auto &a, const auto &b) { return a.second < b.second; });
+  float avgCycles = (float)totalCycles / cyclesPerGlyph.size();
+  os << indent << "Estimated Decode Cycles (AVR):\n";
+  os << indent << "  Total   : " << i2s(totalCycles, 7) << " cycles\n";
+  os << indent << "  Average : " << f2s(avgCycles, 7, 0)
+     << " cycles/glyph\n";
+  os << indent << "  Max     : " << i2s(slowest->second, 7) << " cycles ("
+     << c2s(slowest->first) << ")\n";
+  os << indent << "  Per Glyph:\n";
+  constexpr int GLYPHS_PER_LINE = 4;
+  int i = 0;
+  for (const auto &cyclesPair : cyclesPerGlyph) {
+    if (i % GLYPHS_PER_LINE == 0) os << indent << "   ";
+    os << " " << s2s(c2s(cyclesPair.first), 11) << i2s(cyclesPair.second, 6);
+    i++;
+    if (i % GLYPHS_PER_LINE == 0 || i == (int)cyclesPerGlyph.size()) {
+      os << "\n";
+    }
+  }
+
+  if (corpus.empty()) return;
+  int numChars = corpusSize(corpus);
+  int numMissing = 0;
+  for (const auto &countPair : corpus) {
+    if (!cyclesPerGlyph.contains(countPair.first)) {
+      numMissing += countPair.second;
+    }
+  }
+  float after = expectedCyclesPerChar(cyclesPerGlyph, corpus);
+  os << indent << "Corpus Decode Cycles (AVR):\n";
+  os << indent << "  Characters : " << i2s(numChars, 7) << " ("
+     << numMissing << " not in font)\n";
+  if (!baselineBlob.empty()) {
+    float before =
+        expectedCyclesPerChar(estimateCyclesPerGlyph(baselineBlob), corpus);
+    float ratio = before == 0 ? 0.0f : 100.0f * (after - before) / before;
+    os << indent << "  Before     : " << f2s(before, 9, 1)
+       << " cycles/char (without corpus)\n";
+    os << indent << "  After      : " << f2s(after, 9, 1) << " cycles/char ("
+       << (ratio < 0 ? "-" : "+") << f2s(std::abs(ratio), 5, 2) << "%)\n";
+  } else {
+    os << indent << "  Expected   : " << f2s(after, 9, 1)
+       << " cycles/char\n";
+  }
 }
 
 }  // namespace mamefont::mamec
@@ -5,63 +5,56 @@
 
 namespace mamefont::mamec {
 
-Operation makeLDI(frag_t frag, int addCost) {
-  std::vector<frag_t> output({frag});
-  return makeOperation(mf::Operator::LDI, output, addCost, 0x00, frag);
+OperationDesc describeLDI(frag_t frag, int addCost) {
+  return describeOperation(mf::Operator::LDI, 1, addCost, 0x00, frag);
 }
 
-Operation makeXOR(int pos, bool width2bit, frag_t frag) {
+OperationDesc describeXOR(int pos, bool width2bit) {
   uint8_t arg1 = 0;
   arg1 |= mf::XOR::Pos::place(pos);
   arg1 |= mf::XOR::Width2Bit::place(width2bit);
-  std::vector<frag_t> output({frag});
-  return makeOperation(mf::Operator::XOR, output, 0, arg1);
+  return describeOperation(mf::Operator::XOR, 1, 0, arg1);
 }
 
-Operation makeLUP(int index, frag_t frag) {
+OperationDesc describeLUP(int index) {
   uint8_t arg1 = mf::LUP::Index::place(index);
-  std::vector<frag_t> output({frag});
-  return makeOperation(mf::Operator::LUP, output, 0, arg1);
+  return describeOperation(mf::Operator::LUP, 1, 0, arg1);
 }
 
-Operation makeLUD(int index, int step, frag_t frag1, frag_t frag2) {
+OperationDesc describeLUD(int index, int step) {
   uint8_t arg1 = 0;
   arg1 |= mf::LUD::Index::place(index);
   arg1 |= mf::LUD::Step::place(step == 1);
-  std::vector<frag_t> output({frag1, frag2});
-  return makeOperation(mf::Operator::LUD, output, 0, arg1);
+  return describeOperation(mf::Operator::LUD, 2, 0, arg1);
 }
 
-Operation makeRPT(frag_t frag, int count) {
+OperationDesc describeRPT(int count) {
   uint8_t arg1 = mf::RPT::RepeatCount::place(count);
-  std::vector<frag_t> output;
-  output.resize(count, frag);
-  return makeOperation(mf::Operator::RPT, output, 0, arg1);
+  return describeOperation(mf::Operator::RPT, count, 0, arg1);
 }
 
-Operation makeSFT(bool right, bool postSet, int size, int rpt,
-                  const std::vector<frag_t> &output) {
+OperationDesc describeSFT(bool right, bool postSet, int size, int rpt) {
   uint8_t arg1 = 0;
   arg1 |= mf::SFT::RepeatCount::place(rpt);
   arg1 |= mf::SFT::Size::place(size);
   arg1 |= mf::SFT::PostSet::place(postSet);
   arg1 |= mf::SFT::Right::place(right);
-  return makeOperation(mf::Operator::SFT, output, 0, arg1);
+  return describeOperation(mf::Operator::SFT, rpt, 0, arg1);
 }
 
-Operation makeSFI(bool right, bool postSet, bool preShift, int period, int rpt,
-                  const std::vector<frag_t> &output) {
+OperationDesc describeSFI(bool right, bool postSet, bool preShift, int period,
+                          int rpt) {
   uint8_t arg2 = 0;
   arg2 |= mf::SFI::Period::place(period);
   arg2 |= mf::SFI::RepeatCount::place(rpt);
   arg2 |= mf::SFI::Right::place(right);
   arg2 |= mf::SFI::PostSet::place(postSet);
   arg2 |= mf::SFI::PreShift::place(preShift);
-  return makeOperation(mf::Operator::SFI, output, 0, 0x00, arg2);
+  int length = rpt * period + (preShift ? 1 : 0);
+  return describeOperation(mf::Operator::SFI, length, 0, 0x00, arg2);
 }
 
-Operation makeCPY(int offset, int length, bool byteReverse,
-                  const std::vector<frag_t> &output) {
+OperationDesc describeCPY(int offset, int length, bool byteReverse) {
   uint8_t arg1 = 0;
   arg1 |= mf::CPY::Offset::place(offset);
   arg1 |= mf::CPY::Length::place(length);
@@ -69,11 +62,10 @@ Operation makeCPY(int offset, int length, bool byteReverse,
 
   int addCost = byteReverse ? 1 : 0;
 
-  return makeOperation(mf::Operator::CPY, output, addCost, arg1);
+  return describeOperation(mf::Operator::CPY, length, addCost, arg1);
 }
 
-Operation makeCPX(int offset, int length, uint8_t cpxFlags,
-                  const std::vector<frag_t> &output) {
+OperationDesc describeCPX(int offset, int length, uint8_t cpxFlags) {
   uint8_t arg23[2] = {0x00};
   mf::CPX::Offset::write(arg23, offset);
   uint8_t &arg2 = arg23[0];
@@ -86,6 +78,19 @@ Operation makeCPX(int offset, int length, uint8_t cpxFlags,
   if (mf::CPX::Inverse::read(cpxFlags)) addCost++;
   if (mf::CPX::ByteReverse::read(cpxFlags)) addCost++;
 
-  return makeOperation(mf::Operator::CPX, output, addCost, 0x00, arg2, arg3);
+  return describeOperation(mf::Operator::CPX, length, addCost, 0x00, arg2,
+                           arg3);
+}
+
+Operation makeLDI(frag_t frag, int addCost) {
+  return makeOperation(describeLDI(frag, addCost), {frag});
+}
+
+Operation makeLUP(int index, frag_t frag) {
+  return makeOperation(describeLUP(index), {frag});
+}
+
+Operation makeLUD(int index, int step, frag_t frag1, frag_t frag2) {
+  return makeOperation(describeLUD(index, step), {frag1, frag2});
 }
 }  // namespace mamefont::mamec
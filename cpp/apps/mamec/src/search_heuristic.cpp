@@ -0,0 +1,234 @@
+#include <algorithm>
+#include <climits>
+#include <vector>
+
+#include "mamec/search_heuristic.hpp"
+
+namespace mamefont::mamec {
+
+static std::vector<int> estimateSimple(const HeuristicParams &params,
+                                       int numFrags);
+static std::vector<int> estimateSuffix(const HeuristicParams &params,
+                                       const std::vector<frag_t> &fragments,
+                                       const std::vector<frag_t> &compareMask);
+
+std::vector<int> estimateRemainingCosts(
+    const HeuristicParams &params, const std::vector<frag_t> &fragments,
+    const std::vector<frag_t> &compareMask) {
+  int numFrags = fragments.size();
+  switch (params.type) {
+    case Heuristic::SIMPLE:
+      return estimateSimple(params, numFrags);
+    case Heuristic::SUFFIX:
+      return estimateSuffix(params, fragments, compareMask);
+    default:
+      return std::vector<int>(numFrags + 1, 0);
+  }
+}
+
+// Every remaining fragment costs at least the best cost per fragment that
+// any operator can achieve, regardless of the glyph content.
+static std::vector<int> estimateSimple(const HeuristicParams &params,
+                                       int numFrags) {
+  const CostParams &cost = params.cost;
+  int bestCost = cost.minCostOf(mf::Operator::RPT, 1);
+  int bestLen = 1;
+  // Under the size model the cost does not depend on the length, but the
+  // decoder cycles do, so every length is checked.
+  auto consider = [&](mf::Operator op, int maxLen) {
+    for (int len = 1; len <= maxLen; len++) {
+      int opCost = cost.minCostOf(op, len);
+      if (opCost * bestLen < bestCost * len) {
+        bestCost = opCost;
+        bestLen = len;
+      }
+    }
+  };
+  consider(mf::Operator::LUP, 1);
+  consider(mf::Operator::LDI, 1);
+  consider(mf::Operator::XOR, 1);
+  consider(mf::Operator::RPT, mf::RPT::RepeatCount::MAX);
+  consider(mf::Operator::CPY, mf::CPY::Length::MAX);
+  consider(mf::Operator::SFT, mf::SFT::RepeatCount::MAX);
+  if (!params.noSfi) {
+    consider(mf::Operator::SFI,
+             1 + mf::SFI::Period::MAX * mf::SFI::RepeatCount::MAX);
+  }
+  if (!params.noCpx) {
+    consider(mf::Operator::CPX, mf::CPX::Length::MAX);
+  }
+
+  std::vector<int> remaining(numFrags + 1);
+  for (int pos = 0; pos <= numFrags; pos++) {
+    remaining[pos] = (numFrags - pos) * bestCost / bestLen;
+  }
+  return remaining;
+}
+
+// Shortest path over positions where each operator may cover any length that
+// is not ruled out by the fragments themselves. The content checks only look
+// at pairs of fragments: an output fragment is known to match its target
+// under the compare mask, so two positions conflict only if they disagree on
+// a bit that both masks care about.
+static std::vector<int> estimateSuffix(const HeuristicParams &params,
+                                       const std::vector<frag_t> &fragments,
+                                       const std::vector<frag_t> &compareMask) {
+  const int numFrags = fragments.size();
+  const mf::PixelFormat bpp = params.pixelFormat;
+  const CostParams &cost = params.cost;
+
+  // The decoder starts with zeros before the first fragment
+  auto fragAt = [&](int pos) -> frag_t {
+    return pos < 0 ? 0x00 : fragments[pos];
+  };
+  auto maskAt = [&](int pos) -> frag_t {
+    return pos < 0 ? 0xFF : compareMask[pos];
+  };
+  auto compatible = [&](int src, int dst) {
+    return ((fragAt(src) ^ fragAt(dst)) & maskAt(src) & maskAt(dst)) == 0;
+  };
+
+  // Whether CPX can copy `src` to `dst` with the given flags
+  auto cpxCompatible = [&](int src, int dst, bool pixelReverse,
+                           bool inverse) {
+    frag_t srcFrag = fragAt(src), srcMask = maskAt(src);
+    frag_t dstFrag = fragAt(dst), dstMask = maskAt(dst);
+    if (pixelReverse) {
+      dstFrag = mf::reversePixels(dstFrag, bpp);
+      dstMask = mf::reversePixels(dstMask, bpp);
+    }
+    if (inverse) dstFrag = ~dstFrag;
+    return ((srcFrag ^ dstFrag) & srcMask & dstMask) == 0;
+  };
+
+  constexpr int MAX_LEN = mf::CPX::Length::MAX;
+  std::vector<int> remaining(numFrags + 1, 0);
+  std::vector<int> bestCostOfLen(MAX_LEN + 1);
+
+  auto consider = [&](int len, int cost) {
+    bestCostOfLen[len] = std::min(bestCostOfLen[len], cost);
+  };
+
+  // Longest CPX from each position. A copy reads one run of sources with
+  // one set of flags, so the run has to match as a whole. Forward copies may
+  // overlap their output, and sources before the glyph read as zeros, which
+  // only makes the reach longer than what the encoder can use.
+  std::vector<int> cpxReach(numFrags, 0);
+  if (!params.noCpx) {
+    for (int pos = 0; pos < numFrags; pos++) {
+      int maxLen = std::min(MAX_LEN, numFrags - pos);
+      int reach = 0;
+      for (int flags = 0; flags < 4 && reach < maxLen; flags++) {
+        bool pixelReverse = (flags & 2) != 0;
+        bool inverse = (flags & 1) != 0;
+        for (int start = pos - mf::CPX::Offset::MAX; start < pos; start++) {
+          int len = 0;
+          while (len < maxLen &&
+                 cpxCompatible(start + len, pos + len, pixelReverse, inverse)) {
+            len++;
+          }
+          reach = std::max(reach, len);
+          len = 0;
+          while (len < maxLen && cpxCompatible(start - len, pos + len,
+                                               pixelReverse, inverse)) {
+            len++;
+          }
+          reach = std::max(reach, len);
+          if (reach == maxLen) break;
+        }
+      }
+      cpxReach[pos] = reach;
+    }
+  }
+
+  for (int pos = numFrags - 1; pos >= 0; pos--) {
+    int maxLen = std::min(MAX_LEN, numFrags - pos);
+    std::fill(bestCostOfLen.begin(), bestCostOfLen.end(), INT_MAX);
+
+    // LDI, XOR and SFT are not checked against the content
+    if (params.lupLoadable.empty() || params.lupLoadable[pos]) {
+      consider(1, cost.minCostOf(mf::Operator::LUP, 1));
+    }
+    consider(1, cost.minCostOf(mf::Operator::LDI, 1));
+    consider(1, cost.minCostOf(mf::Operator::XOR, 1));
+    for (int len = 1; len <= mf::SFT::RepeatCount::MAX && len <= maxLen;
+         len++) {
+      consider(len, cost.minCostOf(mf::Operator::SFT, len));
+    }
+
+    // RPT: all fragments must agree with the last one
+    {
+      frag_t known = maskAt(pos - 1);
+      frag_t value = fragAt(pos - 1) & known;
+      for (int len = 1; len <= mf::RPT::RepeatCount::MAX && len <= maxLen;
+           len++) {
+        frag_t f = fragAt(pos + len - 1), m = maskAt(pos + len - 1);
+        if ((value ^ f) & known & m) break;
+        value |= f & m & ~known;
+        known |= m;
+        consider(len, cost.minCostOf(mf::Operator::RPT, len));
+      }
+    }
+
+    // CPY: every offset, length and direction is cheap enough to enumerate
+    for (int len = mf::CPY::Length::MIN;
+         len <= mf::CPY::Length::MAX && len <= maxLen; len++) {
+      for (int offset = mf::CPY::Offset::MIN; offset <= mf::CPY::Offset::MAX;
+           offset++) {
+        for (bool byteReverse : {false, true}) {
+          if (!byteReverse && len == 1 && offset == 0) continue;
+          if (byteReverse && len == 1) continue;
+          bool match = true;
+          for (int i = 0; i < len && match; i++) {
+            int src = byteReverse ? (pos - offset - 1 - i)
+                                  : (pos - offset - len + i);
+            match = compatible(src, pos + i);
+          }
+          if (match) {
+            consider(len, cost.minCostOf(mf::Operator::CPY, len,
+                                         byteReverse ? 1 : 0));
+          }
+        }
+      }
+    }
+
+    // SFI: within a period, all but one fragment repeat the previous one
+    if (!params.noSfi) {
+      FOR_FIELD_VALUES(mf::SFI::Period, period) {
+        for (bool preShift : {false, true}) {
+          int phase = preShift ? 0 : (period - 1);
+          int reach = 0;
+          while (reach < maxLen) {
+            bool shifted = (reach % period) == phase;
+            if (!shifted && !compatible(pos + reach - 1, pos + reach)) break;
+            reach++;
+          }
+          FOR_FIELD_VALUES(mf::SFI::RepeatCount, rpt) {
+            int len = rpt * period + (preShift ? 1 : 0);
+            if (len > reach) break;
+            consider(len, cost.minCostOf(mf::Operator::SFI, len));
+          }
+        }
+      }
+    }
+
+    // CPX: every fragment needs some source within the offset window
+    if (!params.noCpx) {
+      FOR_FIELD_VALUES(mf::CPX::Length, len) {
+        if (len > cpxReach[pos]) break;
+        consider(len, cost.minCostOf(mf::Operator::CPX, len));
+      }
+    }
+
+    int best = INT_MAX;
+    for (int len = 1; len <= maxLen; len++) {
+      if (bestCostOfLen[len] == INT_MAX) continue;
+      best = std::min(best, bestCostOfLen[len] + remaining[pos + len]);
+    }
+    remaining[pos] = best;
+  }
+
+  return remaining;
+}
+
+}  // namespace mamefont::mamec
@@ -0,0 +1,102 @@
+#include <algorithm>
+
+#include <nlohmann/json.hpp>
+
+#include "mamec/search_stats.hpp"
+
+namespace mamefont::mamec {
+
+const char *nameOf(Generator gen) {
+  switch (gen) {
+    case Generator::LUP:
+      return "LUP";
+    case Generator::XOR:
+      return "XOR";
+    case Generator::RPT:
+      return "RPT";
+    case Generator::SFT:
+      return "SFT";
+    case Generator::SFI:
+      return "SFI";
+    case Generator::CPY:
+      return "CPY";
+    case Generator::CPX:
+      return "CPX";
+    default:
+      return "(unknown)";
+  }
+}
+
+static const char *nameOf(SearchOrigin origin) {
+  switch (origin) {
+    case SearchOrigin::SEARCHED:
+      return "searched";
+    case SearchOrigin::REPEATED:
+      return "repeated";
+    case SearchOrigin::CACHED:
+      return "cached";
+    default:
+      return "(unknown)";
+  }
+}
+
+void writeSearchStats(const std::map<int, SearchStats> &stats,
+                      std::ostream &os) {
+  SearchStats total;
+  int numStateCapped = 0;
+  int numCycleRetried = 0;
+  nlohmann::json glyphsJson = nlohmann::json::array();
+  for (const auto &statsPair : stats) {
+    const SearchStats &s = statsPair.second;
+    nlohmann::json candidatesJson = nlohmann::json::object();
+    for (int i = 0; i < (int)Generator::COUNT; i++) {
+      candidatesJson[nameOf((Generator)i)] = s.candidates[i];
+      total.candidates[i] += s.candidates[i];
+    }
+    glyphsJson.push_back({
+        {"code", s.code},
+        {"origin", nameOf(s.origin)},
+        {"fragments", s.numFrags},
+        {"operations", s.numOperations},
+        {"states_created", s.statesCreated},
+        {"states_expanded", s.statesExpanded},
+        {"candidates", candidatesJson},
+        {"peak_queue_size", s.peakQueueSize},
+        {"arena_bytes", s.arenaBytes},
+        {"elapsed_us", s.elapsedUs},
+        {"state_capped", s.stateCapped},
+        {"speed_weight", s.speedWeight},
+        {"cycle_retries", s.cycleRetries},
+    });
+    if (s.stateCapped) numStateCapped++;
+    if (s.cycleRetries > 0) numCycleRetried++;
+    total.statesCreated += s.statesCreated;
+    total.statesExpanded += s.statesExpanded;
+    total.peakQueueSize = std::max(total.peakQueueSize, s.peakQueueSize);
+    total.arenaBytes = std::max(total.arenaBytes, s.arenaBytes);
+    total.elapsedUs += s.elapsedUs;
+  }
+
+  nlohmann::json totalCandidatesJson = nlohmann::json::object();
+  for (int i = 0; i < (int)Generator::COUNT; i++) {
+    totalCandidatesJson[nameOf((Generator)i)] = total.candidates[i];
+  }
+
+  // Peaks are the largest of any glyph; the rest are sums
+  nlohmann::json json;
+  json["total"] = {
+      {"glyphs", stats.size()},
+      {"states_created", total.statesCreated},
+      {"states_expanded", total.statesExpanded},
+      {"candidates", totalCandidatesJson},
+      {"peak_queue_size", total.peakQueueSize},
+      {"arena_bytes", total.arenaBytes},
+      {"elapsed_us", total.elapsedUs},
+      {"state_capped_glyphs", numStateCapped},
+      {"cycle_retried_glyphs", numCycleRetried},
+  };
+  json["glyphs"] = glyphsJson;
+  os << json.dump(2) << std::endl;
+}
+
+}  // namespace mamefont::mamec
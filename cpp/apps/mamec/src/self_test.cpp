@@ -1,7 +1,10 @@
+#include <random>
 #include <string>
+#include <vector>
 
 #include "mamec/encoder.hpp"
 #include "mamec/mamec_common.hpp"
+#include "mamec/masked_compare.hpp"
 #include "mamec/self_test.hpp"
 
 namespace mamefont::mamec {
@@ -33,6 +36,49 @@ void runSelfTests() {
                                ", decoder output=0x" + u2x16(dec));
     }
   }
+
+  // The vectorized match length must agree with the scalar one. The
+  // destination is built from the source, then damaged at one position.
+  std::mt19937 rng(12345);
+  const int maxLength = 80;
+  const int allFlags = mf::CPX::ByteReverse::MASK |
+                       mf::CPX::PixelReverse::MASK | mf::CPX::Inverse::MASK;
+  std::vector<frag_t> src(maxLength), dst(maxLength), mask(maxLength);
+  for (auto bpp : {mf::PixelFormat::BW_1BIT, mf::PixelFormat::GRAY_2BIT}) {
+    for (int cpxFlags = 0; cpxFlags <= allFlags; cpxFlags++) {
+      if (cpxFlags & ~allFlags) continue;
+      bool byteReverse = mf::CPX::ByteReverse::read(cpxFlags);
+      for (int length = 0; length <= maxLength; length++) {
+        for (int i = 0; i < maxLength; i++) {
+          src[i] = rng();
+          mask[i] = (rng() % 4 == 0) ? (frag_t)rng() : 0xFF;
+        }
+        const frag_t *srcPtr = byteReverse ? &src[maxLength - 1] : &src[0];
+        for (int i = 0; i < maxLength; i++) {
+          frag_t frag = byteReverse ? src[maxLength - 1 - i] : src[i];
+          if (mf::CPX::PixelReverse::read(cpxFlags)) {
+            frag = mf::reversePixels(frag, bpp);
+          }
+          if (mf::CPX::Inverse::read(cpxFlags)) frag = ~frag;
+          dst[i] = frag ^ ((frag_t)rng() & ~mask[i]);
+        }
+        if (length > 0) dst[rng() % length] ^= 1 << (rng() % 8);
+
+        int expected = maskedMatchLengthScalar(srcPtr, dst.data(), mask.data(),
+                                               length, cpxFlags, bpp);
+        int actual = maskedMatchLength(srcPtr, dst.data(), mask.data(), length,
+                                       cpxFlags, bpp);
+        if (expected != actual) {
+          throw std::runtime_error(
+              std::string("maskedMatchLength mismatch(): kernel=") +
+              maskedCompareKernelName() + ", cpxFlags=0x" + u2x8(cpxFlags) +
+              ", length=" + std::to_string(length) +
+              ", expected=" + std::to_string(expected) +
+              ", actual=" + std::to_string(actual));
+        }
+      }
+    }
+  }
 }
 
 }  // namespace mamefont::mamec
@@ -0,0 +1,79 @@
+#include <nlohmann/json.hpp>
+
+#include "mamec/trace.hpp"
+
+namespace mamefont::mamec {
+
+Tracer &Tracer::instance() {
+  static Tracer tracer;
+  return tracer;
+}
+
+void Tracer::enable() {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (enabledFlag) return;
+  origin = Clock::now();
+  laneOfThisThread();
+  enabledFlag = true;
+}
+
+int Tracer::laneOfThisThread() {
+  auto id = std::this_thread::get_id();
+  auto it = laneOf.find(id);
+  if (it != laneOf.end()) return it->second;
+  int lane = laneOf.size();
+  laneOf[id] = lane;
+  return lane;
+}
+
+void Tracer::addEvent(const char *name, const std::string &detail,
+                      Clock::time_point begin, Clock::time_point end) {
+  using std::chrono::duration_cast;
+  using std::chrono::microseconds;
+  std::lock_guard<std::mutex> lock(mutex);
+  events.push_back(Event{
+      name,
+      detail,
+      (long)duration_cast<microseconds>(begin - origin).count(),
+      (long)duration_cast<microseconds>(end - begin).count(),
+      laneOfThisThread(),
+  });
+}
+
+void Tracer::write(std::ostream &os) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  nlohmann::json eventsJson = nlohmann::json::array();
+  for (int lane = 0; lane < (int)laneOf.size(); lane++) {
+    std::string laneName =
+        lane == 0 ? "main" : ("worker " + std::to_string(lane));
+    eventsJson.push_back({
+        {"name", "thread_name"},
+        {"ph", "M"},
+        {"pid", 1},
+        {"tid", lane},
+        {"args", {{"name", laneName}}},
+    });
+  }
+  for (const Event &event : events) {
+    nlohmann::json eventJson = {
+        {"name", event.name},
+        {"cat", "mamec"},
+        {"ph", "X"},
+        {"ts", event.beginUs},
+        {"dur", event.durationUs},
+        {"pid", 1},
+        {"tid", event.lane},
+    };
+    if (!event.detail.empty()) {
+      eventJson["args"] = {{"detail", event.detail}};
+    }
+    eventsJson.push_back(eventJson);
+  }
+
+  nlohmann::json json;
+  json["traceEvents"] = eventsJson;
+  json["displayTimeUnit"] = "ms";
+  os << json.dump() << std::endl;
+}
+
+}  // namespace mamefont::mamec
@@ -1,11 +1,126 @@
+#include <algorithm>
 #include <iostream>
+#include <string>
+#include <vector>
 
+#include <mamefont/glyph_cache.hpp>
+#include <mamefont/stream_decoder.hpp>
+#include <mamefont/string_decoder.hpp>
+
+#include "mamec/trace.hpp"
 #include "mamec/verify.hpp"
+#include "mamec/wcet.hpp"
 
 namespace mamefont::mamec {
 
-bool verifyGlyphs(const BitmapFont &bmpFont, const mf::Font &mameFont,
+// Decodes every code of the font as one string and compares each glyph with
+// the one decodeGlyph() gives. The strip is filled with garbage first, as
+// decodeString() does not clear it.
+static bool verifyString(const mf::Font &mameFont) {
+  std::string str;
+  for (int code = mameFont.firstCode(); code <= mameFont.lastCode(); code++) {
+    str.push_back(static_cast<char>(code));
+  }
+
+  std::vector<mf::StringGlyph> glyphs(str.size());
+  uint16_t stripSize =
+      mf::layoutString(mameFont, str.data(), str.size(), glyphs.data());
+  std::vector<uint8_t> strip(stripSize, 0xA5);
+  std::vector<uint8_t> buff(mameFont.calcMaxGlyphBufferSize());
+  try {
+    mf::decodeString(mameFont, str.data(), str.size(), glyphs.data(),
+                     strip.data(), stripSize);
+
+    int16_t x = 0;
+    for (size_t i = 0; i < glyphs.size(); i++) {
+      const mf::Glyph &glyph = glyphs[i].glyph;
+      x -= glyph.xStepBack;
+      bool match = glyphs[i].x == x;
+      x += glyph.glyphWidth + glyph.xSpace;
+      if (match && glyph.isValid()) {
+        mf::Glyph single(buff.data());
+        mameFont.getGlyph(str[i], &single);
+        mf::decodeGlyph(mameFont, &single);
+        uint8_t numTracks, trackLength;
+        glyph.getBufferShape(&numTracks, &trackLength);
+        match = std::equal(glyph.data, glyph.data + numTracks * trackLength,
+                           single.data);
+      }
+      if (!match) {
+        std::cerr << "*ERROR: String decoder mismatch for code "
+                  << c2s(static_cast<uint8_t>(str[i])) << "." << std::endl;
+        return false;
+      }
+    }
+  } catch (const mf::MameFontException &e) {
+    std::cerr << "*ERROR: Decoding the string of all glyphs: " << e.what()
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Reads every glyph through a cache that holds fewer glyphs than the font,
+// twice in a row and then once more backwards, and compares them with the
+// ones decodeGlyph() gives. Of the backward reads, only the first ones up
+// to the number of slots hit: the rest were evicted in the forward pass.
+static bool verifyCache(const mf::Font &mameFont) {
+  constexpr uint8_t NUM_SLOTS = 4;
+  std::vector<uint8_t> arena(
+      mf::GlyphCache::calcArenaSize(mameFont, NUM_SLOTS));
+  mf::GlyphCache cache(mameFont, arena.data(), arena.size());
+  std::vector<uint8_t> buff(mameFont.calcMaxGlyphBufferSize());
+
+  std::vector<int> codes;
+  for (int code = mameFont.firstCode(); code <= mameFont.lastCode(); code++) {
+    mf::Glyph glyph;
+    if (mameFont.getGlyph(code, &glyph) == mf::Status::SUCCESS) {
+      codes.push_back(code);
+      codes.push_back(code);
+    }
+  }
+  int numGlyphs = codes.size() / 2;
+  codes.insert(codes.end(), codes.rbegin(), codes.rend());
+
+  try {
+    for (int code : codes) {
+      mf::Glyph cached, single(buff.data());
+      cache.getGlyph(code, &cached);
+      mameFont.getGlyph(code, &single);
+      mf::decodeGlyph(mameFont, &single);
+      uint8_t numTracks, trackLength;
+      single.getBufferShape(&numTracks, &trackLength);
+      if (cached.glyphWidth != single.glyphWidth ||
+          cached.glyphHeight != single.glyphHeight ||
+          !std::equal(single.data, single.data + numTracks * trackLength,
+                      cached.data)) {
+        std::cerr << "*ERROR: Glyph cache mismatch for code " << c2s(code)
+                  << "." << std::endl;
+        return false;
+      }
+    }
+  } catch (const mf::MameFontException &e) {
+    std::cerr << "*ERROR: Reading glyphs through the cache: " << e.what()
+              << std::endl;
+    return false;
+  }
+
+  uint32_t expectedMisses =
+      numGlyphs * 2 - std::min<int>(numGlyphs, NUM_SLOTS);
+  if (cache.numSlots() != NUM_SLOTS || cache.numMisses() != expectedMisses ||
+      cache.numHits() != codes.size() - expectedMisses) {
+    std::cerr << "*ERROR: Glyph cache counted " << cache.numHits()
+              << " hits and " << cache.numMisses() << " misses in "
+              << static_cast<int>(cache.numSlots()) << " slots." << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool verifyGlyphs(const BitmapFont &bmpFont, const std::vector<uint8_t> &blob,
                   bool verbose, int verboseForCode) {
+  TraceScope trace("verifyGlyphs");
+  const mf::Font mameFont(blob.data());
   mf::Status ret;
 
   if (verbose) {
@@ -33,6 +148,14 @@ bool verifyGlyphs(const BitmapFont &bmpFont, const mf::Font &mameFont,
   mf::Glyph mameGlyph;
   mameGlyph.data = bufferVec.data();
 
+  // The specialized decoder must give the same fragments as the generic one,
+  // without the operators that the byte code does not use
+  mf::GlyphDecoder fixedDecoder =
+      mf::selectDecoder(mameFont, usesOperator(blob, mf::Operator::CPX),
+                        usesOperator(blob, mf::Operator::SFI));
+  mf::Glyph fixedGlyph;
+  fixedGlyph.data = bufferVec.data() + buffSize;
+
   for (int code = 0; code <= 255; code++) {
     mf::Debugger::setVerbose(code == verboseForCode);
 
@@ -42,6 +165,12 @@ bool verifyGlyphs(const BitmapFont &bmpFont, const mf::Font &mameFont,
       if (ret == mf::Status::SUCCESS) {
         ret = mamefont::decodeGlyph(mameFont, &mameGlyph);
       }
+      if (ret == mf::Status::SUCCESS) {
+        mf::Debugger::setVerbose(false);
+        fixedGlyph = mameGlyph;
+        fixedGlyph.data = bufferVec.data() + buffSize;
+        ret = fixedDecoder(mameFont, &fixedGlyph);
+      }
     } catch (const mf::MameFontException &e) {
       ret = e.status;
     }
@@ -71,6 +200,16 @@ bool verifyGlyphs(const BitmapFont &bmpFont, const mf::Font &mameFont,
       continue;
     }
 
+    uint8_t numTracks, trackLength;
+    mameGlyph.getBufferShape(&numTracks, &trackLength);
+    if (!std::equal(mameGlyph.data, mameGlyph.data + numTracks * trackLength,
+                    fixedGlyph.data)) {
+      std::cerr << "*ERROR: Specialized decoder mismatch for code "
+                << c2s(code) << "." << std::endl;
+      totalFailedGlyphs++;
+      continue;
+    }
+
     int numPixelDiff = 0;
     for (int y = 0; y < mameFont.fontHeight(); y++) {
       for (int x = 0; x < bmpGlyph->width; x++) {
@@ -92,6 +231,13 @@ bool verifyGlyphs(const BitmapFont &bmpFont, const mf::Font &mameFont,
     totalGlyphs++;
   }
 
+  if (!verifyString(mameFont)) {
+    totalFailedGlyphs++;
+  }
+  if (!verifyCache(mameFont)) {
+    totalFailedGlyphs++;
+  }
+
   if (verbose) {
     std::cout << "  Totally " << totalGlyphs << " glyphs and " << totalPixels
               << " pixels checked." << std::endl;
@@ -108,4 +254,64 @@ bool verifyGlyphs(const BitmapFont &bmpFont, const mf::Font &mameFont,
   return totalFailedGlyphs == 0;
 }
 
+// Receives the tracks of a streaming decode, checking that they come in
+// order
+struct TrackCollector {
+  std::vector<uint8_t> frags;
+  int numTracks = 0;
+  bool inOrder = true;
+
+  static void sink(void *context, uint8_t track, const mf::frag_t *frags,
+                   uint8_t length) {
+    TrackCollector *self = static_cast<TrackCollector *>(context);
+    if (track != self->numTracks++) self->inOrder = false;
+    self->frags.insert(self->frags.end(), frags, frags + length);
+  }
+};
+
+bool verifyStream(const std::vector<uint8_t> &blob, bool verbose) {
+  TraceScope trace("verifyStream");
+  const mf::Font mameFont(blob.data());
+  int copyWindow;
+  int ringSize = calcStreamBufferSize(blob, &copyWindow);
+  int buffSize = mameFont.calcMaxGlyphBufferSize();
+  if (verbose) {
+    std::cout << "Verifying streaming decode with a ring of " << ringSize
+              << " fragments (copy window: " << copyWindow
+              << ", glyph buffer: " << buffSize << ")..." << std::endl;
+  }
+
+  // Filled with garbage, since nothing in the ring is cleared
+  std::vector<uint8_t> ring(ringSize, 0xA5);
+  std::vector<uint8_t> buff(buffSize);
+  int numFailed = 0;
+  for (int code = mameFont.firstCode(); code <= mameFont.lastCode(); code++) {
+    mf::Glyph glyph(buff.data());
+    if (mameFont.getGlyph(code, &glyph) != mf::Status::SUCCESS) continue;
+
+    TrackCollector collector;
+    try {
+      mf::decodeGlyph(mameFont, &glyph);
+      mf::decodeStream(mameFont, &glyph, ring.data(), ringSize,
+                       TrackCollector::sink, &collector);
+    } catch (const mf::MameFontException &e) {
+      std::cerr << "*ERROR: Streaming decode of code " << c2s(code) << ": "
+                << e.what() << std::endl;
+      numFailed++;
+      continue;
+    }
+
+    uint8_t numTracks, trackLength;
+    glyph.getBufferShape(&numTracks, &trackLength);
+    if (!collector.inOrder || collector.numTracks != numTracks ||
+        !std::equal(collector.frags.begin(), collector.frags.end(),
+                    glyph.data, glyph.data + numTracks * trackLength)) {
+      std::cerr << "*ERROR: Streaming decoder mismatch for code " << c2s(code)
+                << "." << std::endl;
+      numFailed++;
+    }
+  }
+  return numFailed == 0;
+}
+
 }  // namespace mamefont::mamec
@@ -0,0 +1,199 @@
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+#include "mamec/cost_model.hpp"
+#include "mamec/operation.hpp"
+#include "mamec/wcet.hpp"
+
+namespace mamefont::mamec {
+
+// Number of fragments the instruction in `code` generates
+static int outputLengthOf(mf::Operator op, const uint8_t *code) {
+  switch (op) {
+    case mf::Operator::LUP:
+    case mf::Operator::LDI:
+    case mf::Operator::XOR:
+      return 1;
+    case mf::Operator::LUD:
+      return 2;
+    case mf::Operator::RPT:
+      return mf::RPT::RepeatCount::read(code[0]);
+    case mf::Operator::SFT:
+      return mf::SFT::RepeatCount::read(code[0]);
+    case mf::Operator::SFI:
+      return mf::SFI::RepeatCount::read(code[1]) *
+                 mf::SFI::Period::read(code[1]) +
+             (mf::SFI::PreShift::read(code[1]) ? 1 : 0);
+    case mf::Operator::CPY:
+      return mf::CPY::Length::read(code[0]);
+    case mf::Operator::CPX:
+      return mf::CPX::Length::read(code[2]);
+    default:
+      return 0;
+  }
+}
+
+// Calls `onInst` with each instruction of each glyph defined in `blob`, in
+// decoding order, and the fragment position it starts at
+static void walkByteCode(
+    const std::vector<uint8_t> &blob,
+    const std::function<void(int code, const mf::Glyph &glyph,
+                             const OperationDesc &desc, int cursor)> &onInst) {
+  const mf::Font font(blob.data());
+  const uint8_t *byteCode = blob.data() + font.byteCodeOffset();
+  const uint8_t *blobEnd = blob.data() + blob.size();
+
+  for (int code = font.firstCode(); code <= font.lastCode(); code++) {
+    mf::Glyph glyph(nullptr);
+    mf::Status ret;
+    try {
+      ret = font.getGlyph(code, &glyph);
+    } catch (const mf::MameFontException &e) {
+      ret = e.status;
+    }
+    if (ret != mf::Status::SUCCESS) continue;
+
+    uint8_t numTracks, trackLength;
+    glyph.getBufferShape(&numTracks, &trackLength);
+    int numFrags = numTracks * trackLength;
+
+    const uint8_t *pc = byteCode + glyph.entryPoint;
+    int cursor = 0;
+    while (cursor < numFrags) {
+      mf::Operator op =
+          pc < blobEnd ? mf::operatorOf(*pc) : mf::Operator::NONE;
+      if (op == mf::Operator::NONE || op == mf::Operator::ABO ||
+          pc + mf::instSizeOf(op) > blobEnd) {
+        throw std::runtime_error("Invalid byte code in glyph " + c2s(code) +
+                                 " at " + std::to_string(pc - byteCode));
+      }
+      OperationDesc desc{op, mf::instSizeOf(op), {pc[0], 0, 0}, 0, 0};
+      for (int i = 1; i < desc.codeLength; i++) desc.code[i] = pc[i];
+      desc.outputLength = outputLengthOf(op, desc.code);
+      onInst(code, glyph, desc, cursor);
+      cursor += desc.outputLength;
+      pc += desc.codeLength;
+    }
+  }
+}
+
+// Longest distance from the cursor back to a fragment that the copy in
+// `desc` reads, following copyCore(). Fragments before the glyph are not
+// read.
+static int copyWindowOf(const OperationDesc &desc, int cursor) {
+  int first, step;
+  if (desc.op == mf::Operator::CPY) {
+    int offset = mf::CPY::Offset::read(desc.code[0]);
+    if (mf::CPY::ByteReverse::read(desc.code[0])) {
+      first = cursor - offset - 1;
+      step = -1;
+    } else {
+      first = cursor - offset - desc.outputLength;
+      step = 1;
+    }
+  } else if (desc.op == mf::Operator::CPX) {
+    int offset = mf::CPX::Offset::read((desc.code[2] << 8) | desc.code[1]);
+    if (mf::CPX::ByteReverse::read(desc.code[2])) {
+      first = cursor - offset + desc.outputLength - 1;
+      step = -1;
+    } else {
+      first = cursor - offset;
+      step = 1;
+    }
+  } else {
+    return 0;
+  }
+
+  int window = 0;
+  for (int i = 0; i < desc.outputLength; i++) {
+    int readPos = first + step * i;
+    if (readPos >= 0) window = std::max(window, cursor + i - readPos);
+  }
+  return window;
+}
+
+std::map<int, GlyphWcet> analyzeWcet(const std::vector<uint8_t> &blob) {
+  const mf::Font font(blob.data());
+  mf::PixelFormat bpp = font.fragFormat();
+
+  std::map<int, GlyphWcet> wcet;
+  walkByteCode(blob, [&](int code, const mf::Glyph &glyph,
+                         const OperationDesc &desc, int cursor) {
+    if (!wcet.contains(code)) {
+      uint8_t numTracks, trackLength;
+      glyph.getBufferShape(&numTracks, &trackLength);
+      wcet[code].setupCycles =
+          estimateGlyphSetupCycles(numTracks * trackLength,
+                                   glyph.useAltTop() || glyph.useAltBottom());
+    }
+    GlyphWcet &w = wcet[code];
+    w.instCycles += estimateDecodeCycles(desc, bpp);
+    w.numInsts++;
+  });
+  return wcet;
+}
+
+bool usesOperator(const std::vector<uint8_t> &blob, mf::Operator op) {
+  bool used = false;
+  walkByteCode(blob, [&](int code, const mf::Glyph &glyph,
+                         const OperationDesc &desc, int cursor) {
+    if (desc.op == op) used = true;
+  });
+  return used;
+}
+
+int calcStreamBufferSize(const std::vector<uint8_t> &blob,
+                         int *maxCopyWindow) {
+  std::map<int, int> windows;
+  std::map<int, int> trackLengths;
+  walkByteCode(blob, [&](int code, const mf::Glyph &glyph,
+                         const OperationDesc &desc, int cursor) {
+    uint8_t numTracks, trackLength;
+    glyph.getBufferShape(&numTracks, &trackLength);
+    trackLengths[code] = trackLength;
+    windows[code] = std::max(windows[code], copyWindowOf(desc, cursor));
+  });
+
+  // decodeStream() uses as many whole tracks of the ring as fit
+  int bufferSize = 0;
+  if (maxCopyWindow) *maxCopyWindow = 0;
+  for (const auto &windowPair : windows) {
+    int trackLength = trackLengths[windowPair.first];
+    int window = std::max(windowPair.second, trackLength);
+    int numTracks = (window + trackLength - 1) / trackLength;
+    bufferSize = std::max(bufferSize, numTracks * trackLength);
+    if (maxCopyWindow) {
+      *maxCopyWindow = std::max(*maxCopyWindow, windowPair.second);
+    }
+  }
+  return bufferSize;
+}
+
+int reportWcet(const std::map<int, GlyphWcet> &wcet, int maxCycles,
+               std::ostream &os, const std::string &indent) {
+  std::vector<std::pair<int, GlyphWcet>> sorted(wcet.begin(), wcet.end());
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](const auto &a, const auto &b) {
+                     return a.second.cycles() > b.second.cycles();
+                   });
+
+  int numViolations = 0;
+  os << indent << "Worst-Case Decode Cycles (AVR):\n";
+  if (maxCycles > 0) {
+    os << indent << "  Bound: " << maxCycles << " cycles\n";
+  }
+  os << indent << "  Glyph       Cycles (Setup + Insts)  Insts\n";
+  for (const auto &wcetPair : sorted) {
+    const GlyphWcet &w = wcetPair.second;
+    bool violated = maxCycles > 0 && w.cycles() > maxCycles;
+    if (violated) numViolations++;
+    os << indent << "  " << s2s(c2s(wcetPair.first), 11)
+       << i2s(w.cycles(), 7) << " (" << i2s(w.setupCycles, 5) << " + "
+       << i2s(w.instCycles, 6) << ")" << i2s(w.numInsts, 7)
+       << (violated ? "  *EXCEEDED*" : "") << "\n";
+  }
+  return numViolations;
+}
+
+}  // namespace mamefont::mamec
@@ -109,7 +109,6 @@ struct FontHeader {
 
   MAMEFONT_NOINLINE void loadFromBlob(const uint8_t *blob) {
     const uint8_t *ptr = blob;
-    uint8_t byte;
     formatVersion = FontHeader::FormatVersion::read(readBlobU8(ptr++));
     flags = FontHeader::Flags::read(readBlobU8(ptr++));
     firstCode = FontHeader::FirstCode::read(readBlobU8(ptr++));
@@ -21,11 +21,13 @@ class Debugger {
   Operator *dbgOpLog = nullptr;
   prog_cntr_t dbgStartPc = 0;
   prog_cntr_t dbgLastPc = 0;
+  bool dbgStreaming = false;
 
   int dbgNumInstsPerOpr[static_cast<int>(Operator::COUNT)] = {0};
   int dbgGenFragsPerOpr[static_cast<int>(Operator::COUNT)] = {0};
 
-  void init(const Glyph *glyph, const DecoderContext &ctx);
+  void init(const Glyph *glyph, const DecoderContext &ctx,
+            bool streaming = false);
   void logInstructionPerformance(Operator op, int size);
   void dbgBeforeFetch(const DecoderContext &ctx);
   void dbgAfterOp(const DecoderContext &ctx, uint8_t len);
@@ -39,7 +41,8 @@ class Debugger {
 
 bool decoderVerbose;
 
-void Debugger::init(const Glyph *glyph, const DecoderContext &ctx) {
+void Debugger::init(const Glyph *glyph, const DecoderContext &ctx,
+                    bool streaming) {
   if (decoderVerbose) {
     printf("----------------------------------------\n");
     printf("MameFont Decoder Debugger\n");
@@ -53,6 +56,7 @@ void Debugger::init(const Glyph *glyph, const DecoderContext &ctx) {
   }
   dbgStartPc = dbgLastPc = (ctx.pc - ctx.bytecode);
   dbgDumpCursor = ctx.cursor;
+  dbgStreaming = streaming;
 
   if (dbgOpLog) delete[] dbgOpLog;
   dbgOpLog = new Operator[ctx.numTracks * ctx.trackLength];
@@ -115,7 +119,8 @@ void Debugger::dbgAfterOp(const DecoderContext &ctx, uint8_t len) {
   dbgLastPc = ctx.pc - ctx.bytecode;
   logInstructionPerformance(dbgLastOp, (len));
 
-  if (!decoderVerbose) return;
+  // The fragments of a streaming decode may be gone from the ring by now
+  if (!decoderVerbose || dbgStreaming) return;
 
   for (int i = 0; i < (len); i++) {
     if (i % 16 == 0 && i > 0) {
@@ -149,11 +154,11 @@ using Debugger = uint8_t;
 
 #define MAMEFONT_BEFORE_OP(dbg, ctx, op, fmt, ...) \
   do {                                             \
-  } while (true)
+  } while (false)
 
 #define MAMEFONT_AFTER_OP(dbg, ctx, len) \
   do {                                   \
-  } while (true)
+  } while (false)
 
 }  // namespace mamefont
 
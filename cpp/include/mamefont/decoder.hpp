@@ -20,78 +20,39 @@
 
 namespace mamefont {
 
-Status decodeGlyph(const Font &font, Glyph *glyph);
-
-#ifdef MAMEFONT_DEBUG
-Status decodeGlyph(const Font &font, Glyph *glyph, Debugger &dbg);
-#endif
-
-#ifdef MAMEFONT_INCLUDE_IMPL
-
-#ifdef MAMEFONT_DEBUG
-Status decodeGlyph(const Font &font, Glyph *glyph) {
-  Debugger dbg;
-  return decodeGlyph(font, glyph, dbg);
-}
-
-Status decodeGlyph(const Font &font, Glyph *glyph, Debugger &dbg)
-#else
-Status decodeGlyph(const Font &font, Glyph *glyph)
-#endif
-{
-  if (!glyph || !(glyph->data)) {
-    MAMEFONT_THROW_OR_RETURN(Status::NULL_POINTER);
-  }
-  if (!glyph->isValid()) {
-    MAMEFONT_THROW_OR_RETURN(Status::GLYPH_NOT_DEFINED);
-  }
-
-  DecoderContext ctx(font, glyph);
-#ifdef MAMEFONT_DEBUG
-  dbg.init(glyph, ctx);
-#else
-  Debugger dbg = 0;
-#endif
-
-  constexpr uint8_t ALT_TOP_BOTTOM_MASK =
-      Glyph::UseAltTop::MASK | Glyph::UseAltBottom::MASK;
-  if (glyph->flags & ALT_TOP_BOTTOM_MASK) {
-    frag_t *wrptr = glyph->data;
-    for (uint8_t j = 0; j < ctx.numTracks; j++) {
-      for (uint8_t i = 0; i < ctx.trackLength; i++) {
-        *(wrptr++) = 0x00;
-      }
-    }
-  }
-
-  while (ctx.cursor < ctx.endPos) {
-    uint8_t inst = ctx.fetch();
+// Runs the instruction that starts with `inst`, decoding its opcode with the
+// branch cascade, or with a table if Traits::TABLE_DISPATCH. Kept apart so
+// that the table is only instantiated where it is used.
+template <typename Traits, bool TABLE = Traits::TABLE_DISPATCH>
+struct InstDispatcher;
 
+template <typename Traits>
+struct InstDispatcher<Traits, false> {
+  static MAMEFONT_INLINE Status run(DecoderContext &ctx, Debugger &dbg,
+                                    uint8_t inst) {
     if ((inst & 0x80) == 0) {
       if ((inst & 0x40) == 0) {
         // 0x00-3F
-        SFT(ctx, dbg, inst);
+        SFT<Traits>(ctx, dbg, inst);
       } else if (((inst & 0x20) == 0) || (((inst & 0x07) != 0))) {
         // 0x40-7F except 0x60, 0x68, 0x70, 0x78
         if (inst == 0x40) {
-#ifdef MAMEFONT_NO_CPX
-          MAMEFONT_THROW_OR_RETURN(Status::UNKNOWN_OPCODE);
-#else
-          CPX(ctx, dbg, inst);
-#endif
+          if (!Traits::CPX_ENABLED) {
+            MAMEFONT_THROW_OR_RETURN(Status::UNKNOWN_OPCODE);
+          }
+          CPX<Traits>(ctx, dbg, inst);
         } else {
-          CPY(ctx, dbg, inst);
+          CPY<Traits>(ctx, dbg, inst);
         }
       } else if ((inst & 0x10) == 0) {
         // 0x60, 0x68
         if ((inst & 0x08) == 0) {
-          LDI(ctx, dbg, inst);
+          LDI<Traits>(ctx, dbg, inst);
         } else {
-#ifdef MAMEFONT_NO_SFI
-          MAMEFONT_THROW_OR_RETURN(Status::UNKNOWN_OPCODE);
-#else
-          SFI(ctx, dbg, inst);
-#endif
+          if (!Traits::SFI_ENABLED) {
+            MAMEFONT_THROW_OR_RETURN(Status::UNKNOWN_OPCODE);
+          }
+          SFI<Traits>(ctx, dbg, inst);
         }
       } else {
         // 0x70, 0x78
@@ -100,26 +61,172 @@ Status decodeGlyph(const Font &font, Glyph *glyph)
     } else {
       if ((inst & 0x40) == 0) {
         // 0x80-BF
-        LUP(ctx, dbg, inst);
+        LUP<Traits>(ctx, dbg, inst);
       } else if ((inst & 0x20) == 0) {
         // 0xC0-DF
-        LUD(ctx, dbg, inst);
+        LUD<Traits>(ctx, dbg, inst);
       } else if ((inst & 0x10) == 0) {
         // 0xE0-EF
-        RPT(ctx, dbg, inst);
+        RPT<Traits>(ctx, dbg, inst);
       } else {
         // 0xF0-FE
         if (inst == 0xFF) {
           MAMEFONT_THROW_OR_RETURN(Status::ABORTED_BY_ABO);
         } else {
-          XOR(ctx, dbg, inst);
+          XOR<Traits>(ctx, dbg, inst);
         }
       }
     }
+    return Status::SUCCESS;
+  }
+};
+
+template <typename Traits>
+struct InstDispatcher<Traits, true> {
+  static MAMEFONT_INLINE Status run(DecoderContext &ctx, Debugger &dbg,
+                                    uint8_t inst) {
+    static constexpr OperatorTable OPERATORS;
+
+    // One load and an indirect jump instead of up to five branches
+    switch (OPERATORS.ops[inst]) {
+      case Operator::SFT: SFT<Traits>(ctx, dbg, inst); break;
+      case Operator::CPY: CPY<Traits>(ctx, dbg, inst); break;
+      case Operator::CPX:
+        if (!Traits::CPX_ENABLED) {
+          MAMEFONT_THROW_OR_RETURN(Status::UNKNOWN_OPCODE);
+        }
+        CPX<Traits>(ctx, dbg, inst);
+        break;
+      case Operator::LDI: LDI<Traits>(ctx, dbg, inst); break;
+      case Operator::SFI:
+        if (!Traits::SFI_ENABLED) {
+          MAMEFONT_THROW_OR_RETURN(Status::UNKNOWN_OPCODE);
+        }
+        SFI<Traits>(ctx, dbg, inst);
+        break;
+      case Operator::LUP: LUP<Traits>(ctx, dbg, inst); break;
+      case Operator::LUD: LUD<Traits>(ctx, dbg, inst); break;
+      case Operator::RPT: RPT<Traits>(ctx, dbg, inst); break;
+      case Operator::XOR: XOR<Traits>(ctx, dbg, inst); break;
+      case Operator::ABO:
+        MAMEFONT_THROW_OR_RETURN(Status::ABORTED_BY_ABO);
+      default: MAMEFONT_THROW_OR_RETURN(Status::UNKNOWN_OPCODE);
+    }
+    return Status::SUCCESS;
+  }
+};
+
+// Runs the byte code of the glyph that `ctx` is set up for until its
+// buffer is filled
+template <typename Traits>
+Status runDecoder(DecoderContext &ctx, Debugger &dbg) {
+  while (ctx.cursor < ctx.endPos) {
+    Status ret = InstDispatcher<Traits>::run(ctx, dbg, ctx.fetch());
+    if (ret != Status::SUCCESS) return ret;
   }
   return Status::SUCCESS;
 }
 
+// Decodes `glyph` with the font properties in `Traits` fixed at compile
+// time. The font must match them, see selectDecoder().
+template <typename Traits>
+Status decodeGlyph(const Font &font, Glyph *glyph, Debugger &dbg) {
+  if (!glyph || !(glyph->data)) {
+    MAMEFONT_THROW_OR_RETURN(Status::NULL_POINTER);
+  }
+  if (!glyph->isValid()) {
+    MAMEFONT_THROW_OR_RETURN(Status::GLYPH_NOT_DEFINED);
+  }
+
+  DecoderContext ctx(font, glyph, Traits());
+#ifdef MAMEFONT_DEBUG
+  dbg.init(glyph, ctx);
+#endif
+
+  // Only large fonts have the alternative top and bottom
+  constexpr uint8_t ALT_TOP_BOTTOM_MASK =
+      Glyph::UseAltTop::MASK | Glyph::UseAltBottom::MASK;
+  if (Traits::largeFont(ctx.flags) && (glyph->flags & ALT_TOP_BOTTOM_MASK)) {
+    frag_t *wrptr = glyph->data;
+    for (uint8_t j = 0; j < ctx.numTracks; j++) {
+      for (uint8_t i = 0; i < ctx.trackLength; i++) {
+        *(wrptr++) = 0x00;
+      }
+    }
+  }
+
+  return runDecoder<Traits>(ctx, dbg);
+}
+
+template <typename Traits>
+MAMEFONT_INLINE Status decodeGlyph(const Font &font, Glyph *glyph) {
+  Debugger dbg{};
+  return decodeGlyph<Traits>(font, glyph, dbg);
+}
+
+Status decodeGlyph(const Font &font, Glyph *glyph);
+
+#ifdef MAMEFONT_DEBUG
+Status decodeGlyph(const Font &font, Glyph *glyph, Debugger &dbg);
+#endif
+
+using GlyphDecoder = Status (*)(const Font &font, Glyph *glyph);
+
+template <bool CPX, bool SFI>
+static inline GlyphDecoder selectDecoderOf(const Font &font) {
+  static constexpr PixelFormat BPP1 = PixelFormat::BW_1BIT;
+  static constexpr PixelFormat BPP2 = PixelFormat::GRAY_2BIT;
+  bool bpp1 = font.fragFormat() == BPP1;
+  bool vert = font.verticalFragment();
+  bool large = font.largeFont();
+  if (bpp1) {
+    if (vert) {
+      if (large) return decodeGlyph<FixedTraits<BPP1, true, true, CPX, SFI>>;
+      return decodeGlyph<FixedTraits<BPP1, true, false, CPX, SFI>>;
+    } else {
+      if (large) return decodeGlyph<FixedTraits<BPP1, false, true, CPX, SFI>>;
+      return decodeGlyph<FixedTraits<BPP1, false, false, CPX, SFI>>;
+    }
+  } else {
+    if (vert) {
+      if (large) return decodeGlyph<FixedTraits<BPP2, true, true, CPX, SFI>>;
+      return decodeGlyph<FixedTraits<BPP2, true, false, CPX, SFI>>;
+    } else {
+      if (large) return decodeGlyph<FixedTraits<BPP2, false, true, CPX, SFI>>;
+      return decodeGlyph<FixedTraits<BPP2, false, false, CPX, SFI>>;
+    }
+  }
+}
+
+// Picks the decodeGlyph() specialized for the pixel format, fragment
+// orientation and size class of `font`, and for whether its byte code uses
+// CPX and SFI: pass false for fonts encoded with --no_cpx or --no_sfi.
+// Meant to be called once per font, with the result used for all of its
+// glyphs.
+static inline GlyphDecoder selectDecoder(
+    const Font &font, bool cpx = RuntimeTraits::CPX_ENABLED,
+    bool sfi = RuntimeTraits::SFI_ENABLED) {
+  // Never instantiates what the MAMEFONT_NO_* macros leave out
+  constexpr bool CPX = RuntimeTraits::CPX_ENABLED;
+  constexpr bool SFI = RuntimeTraits::SFI_ENABLED;
+  if (cpx && sfi) return selectDecoderOf<CPX, SFI>(font);
+  if (cpx) return selectDecoderOf<CPX, false>(font);
+  if (sfi) return selectDecoderOf<false, SFI>(font);
+  return selectDecoderOf<false, false>(font);
+}
+
+#ifdef MAMEFONT_INCLUDE_IMPL
+
+Status decodeGlyph(const Font &font, Glyph *glyph) {
+  return decodeGlyph<RuntimeTraits>(font, glyph);
+}
+
+#ifdef MAMEFONT_DEBUG
+Status decodeGlyph(const Font &font, Glyph *glyph, Debugger &dbg) {
+  return decodeGlyph<RuntimeTraits>(font, glyph, dbg);
+}
+#endif
+
 #endif
 
 }  // namespace mamefont
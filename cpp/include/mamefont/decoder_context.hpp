@@ -5,6 +5,7 @@
 #endif
 
 #include "mamefont/blob_format.hpp"
+#include "mamefont/decoder_traits.hpp"
 #include "mamefont/decoder_utils.hpp"
 #include "mamefont/font.hpp"
 #include "mamefont/glyph.hpp"
@@ -13,6 +14,11 @@
 
 namespace mamefont {
 
+// Receives the fragments of track `track` of a glyph decoded by
+// decodeStream(), as soon as the track is complete
+using TrackSink = void (*)(void *context, uint8_t track, const frag_t *frags,
+                           uint8_t length);
+
 struct DecoderContext {
   FontFlags flags;
   uint8_t numTracks;
@@ -26,11 +32,22 @@ struct DecoderContext {
   frag_index_t cursor;
   frag_index_t endPos;
 
-  DecoderContext(const Font &font, Glyph *glyph) {
-    flags = font.header.flags;
-    fragTable = font.blob + font.fragmentTableOffset();
-    bytecode = font.blob + font.byteCodeOffset();
-    glyph->getBufferShape(&numTracks, &trackLength);
+  DecoderContext(const Font &font, Glyph *glyph)
+      : DecoderContext(font, glyph, RuntimeTraits()) {}
+
+  template <typename Traits>
+  DecoderContext(const Font &font, Glyph *glyph, Traits)
+      : DecoderContext(font.header.flags,
+                       font.blob + font.fragmentTableOffset(),
+                       font.blob + font.byteCodeOffset(), glyph, Traits()) {}
+
+  // Same as above with the fragment table and the byte code already
+  // located in the blob, for decoding many glyphs of a font in a row
+  template <typename Traits>
+  DecoderContext(FontFlags flags, const frag_t *fragTable,
+                 const uint8_t *bytecode, Glyph *glyph, Traits)
+      : flags(flags), fragTable(fragTable), bytecode(bytecode) {
+    Traits::getBufferShape(glyph, &numTracks, &trackLength);
 
     data = glyph->data;
     cursor = 0;
@@ -40,6 +57,75 @@ struct DecoderContext {
   }
 
   MAMEFONT_INLINE uint8_t fetch() { return readBlobU8(pc++); }
+
+  // Stores `frag` at the cursor and advances it
+  template <typename Traits>
+  MAMEFONT_INLINE void put(frag_t frag);
+
+  // Fragment `index` of the glyph, which must be behind the cursor. In the
+  // ring, it must not have been overwritten yet.
+  template <typename Traits>
+  MAMEFONT_INLINE frag_t at(frag_index_t index);
+};
+
+// Context of decodeStream(), kept apart so that the other decoders do not
+// carry its state. `data` is a ring of `ringSize` fragments, whose first
+// entry holds fragment `ringBase` of the glyph.
+struct StreamContext : DecoderContext {
+  frag_index_t ringSize = 0;
+  frag_index_t ringBase = 0;
+  frag_index_t trackEnd = 0;
+  uint8_t track = 0;
+  bool windowExceeded = false;
+  TrackSink sink = nullptr;
+  void *sinkContext = nullptr;
+
+  using DecoderContext::DecoderContext;
+
+  // Hands the track just completed to the sink, unless a copy read past the
+  // ring on the way. The ring holds a whole number of tracks, so it wraps
+  // around only here.
+  MAMEFONT_NOINLINE void completeTrack() {
+    if (!windowExceeded) {
+      sink(sinkContext, track, data + (cursor - trackLength - ringBase),
+           trackLength);
+    }
+    track++;
+    trackEnd += trackLength;
+    if (cursor - ringBase == ringSize) ringBase = cursor;
+  }
+
+  // Called for a read from the ring that has been overwritten. Decoding
+  // stops after the current instruction.
+  MAMEFONT_NOINLINE void exceedWindow() {
+    windowExceeded = true;
+    endPos = cursor;
+  }
 };
 
+template <typename Traits>
+MAMEFONT_INLINE void DecoderContext::put(frag_t frag) {
+  if (Traits::STREAMING) {
+    StreamContext &stream = static_cast<StreamContext &>(*this);
+    data[cursor++ - stream.ringBase] = frag;
+    if (cursor == stream.trackEnd) stream.completeTrack();
+  } else {
+    data[cursor++] = frag;
+  }
+}
+
+template <typename Traits>
+MAMEFONT_INLINE frag_t DecoderContext::at(frag_index_t index) {
+  if (Traits::STREAMING) {
+    StreamContext &stream = static_cast<StreamContext &>(*this);
+    if (index < cursor - stream.ringSize) {
+      stream.exceedWindow();
+      return 0x00;
+    }
+    index -= stream.ringBase;
+    if (index < 0) index += stream.ringSize;
+  }
+  return data[index];
+}
+
 }  // namespace mamefont
\ No newline at end of file
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "mamefont/blob_format.hpp"
+#include "mamefont/glyph.hpp"
+#include "mamefont/mamefont_common.hpp"
+
+namespace mamefont {
+
+#ifdef MAMEFONT_TABLE_DISPATCH
+static constexpr bool DEFAULT_TABLE_DISPATCH = true;
+#else
+static constexpr bool DEFAULT_TABLE_DISPATCH = false;
+#endif
+
+template <bool BPP1>
+struct ShiftState {
+  using type = uint16_t;
+};
+
+template <>
+struct ShiftState<true> {
+  using type = frag_t;
+};
+
+// Decoder properties read from the font at runtime. The MAMEFONT_*_ONLY,
+// MAMEFONT_NO_CPX and MAMEFONT_NO_SFI macros pin them at compile time.
+struct RuntimeTraits {
+#ifdef MAMEFONT_NO_CPX
+  static constexpr bool CPX_ENABLED = false;
+#else
+  static constexpr bool CPX_ENABLED = true;
+#endif
+#ifdef MAMEFONT_NO_SFI
+  static constexpr bool SFI_ENABLED = false;
+#else
+  static constexpr bool SFI_ENABLED = true;
+#endif
+  static constexpr bool TABLE_DISPATCH = DEFAULT_TABLE_DISPATCH;
+  static constexpr bool STREAMING = false;
+
+#if defined(MAMEFONT_1BPP_ONLY)
+  using shift_state_t = ShiftState<true>::type;
+#else
+  using shift_state_t = ShiftState<false>::type;
+#endif
+
+  static MAMEFONT_INLINE PixelFormat fragFormat(FontFlags flags) {
+    return flags.fragFormat();
+  }
+  static MAMEFONT_INLINE bool largeFont(FontFlags flags) {
+    return flags.largeFont();
+  }
+  static MAMEFONT_INLINE void getBufferShape(const Glyph *glyph,
+                                             uint8_t *numTracks,
+                                             uint8_t *trackLength) {
+    glyph->getBufferShape(numTracks, trackLength);
+  }
+};
+
+// Decoder properties fixed for one kind of font. The pixel order is not
+// among them since it does not change how fragments are decoded.
+template <PixelFormat Param_FRAG_FORMAT, bool Param_VERTICAL_FRAGMENT,
+          bool Param_LARGE_FONT,
+          bool Param_CPX_ENABLED = RuntimeTraits::CPX_ENABLED,
+          bool Param_SFI_ENABLED = RuntimeTraits::SFI_ENABLED,
+          bool Param_TABLE_DISPATCH = DEFAULT_TABLE_DISPATCH>
+struct FixedTraits {
+  static constexpr PixelFormat FRAG_FORMAT = Param_FRAG_FORMAT;
+  static constexpr bool VERTICAL_FRAGMENT = Param_VERTICAL_FRAGMENT;
+  static constexpr bool LARGE_FONT = Param_LARGE_FONT;
+  static constexpr bool CPX_ENABLED = Param_CPX_ENABLED;
+  static constexpr bool SFI_ENABLED = Param_SFI_ENABLED;
+  static constexpr bool TABLE_DISPATCH = Param_TABLE_DISPATCH;
+  static constexpr bool STREAMING = false;
+
+  using shift_state_t =
+      typename ShiftState<FRAG_FORMAT == PixelFormat::BW_1BIT>::type;
+
+  static MAMEFONT_INLINE PixelFormat fragFormat(FontFlags) {
+    return FRAG_FORMAT;
+  }
+  static MAMEFONT_INLINE bool largeFont(FontFlags) { return LARGE_FONT; }
+  static MAMEFONT_INLINE void getBufferShape(const Glyph *glyph,
+                                             uint8_t *numTracks,
+                                             uint8_t *trackLength) {
+    uint8_t viewport =
+        VERTICAL_FRAGMENT ? glyph->glyphHeight : glyph->glyphWidth;
+    if (FRAG_FORMAT == PixelFormat::BW_1BIT) {
+      *numTracks = (viewport + 7) / 8;
+    } else {
+      *numTracks = (viewport + 3) / 4;
+    }
+    *trackLength = VERTICAL_FRAGMENT ? glyph->glyphWidth : glyph->glyphHeight;
+  }
+};
+
+// `Base` decoding into a ring buffer for decodeStream()
+template <typename Base = RuntimeTraits>
+struct StreamingTraits : Base {
+  static constexpr bool STREAMING = true;
+};
+
+}  // namespace mamefont
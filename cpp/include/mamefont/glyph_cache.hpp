@@ -0,0 +1,173 @@
+#pragma once
+
+#ifdef MAMEFONT_EXCEPTIONS
+#include <stdexcept>
+#endif
+
+#include "mamefont/decoder.hpp"
+#include "mamefont/font.hpp"
+#include "mamefont/glyph.hpp"
+#include "mamefont/mamefont_common.hpp"
+
+namespace mamefont {
+
+// Keeps the recently decoded glyphs of a font in an arena supplied by the
+// caller. Each slot holds the metrics of a glyph and a buffer of
+// Font::calcMaxGlyphBufferSize() fragments. When all slots are used, one is
+// evicted in CLOCK order: a slot hit since the hand last passed it is
+// spared once.
+//
+// Not included by mamefont.hpp; include this header to use the cache.
+class GlyphCache {
+ public:
+  struct Slot {
+    Glyph glyph;
+    uint8_t code;
+    bool used;
+    bool referenced;
+  };
+
+  const Font &font;
+
+  GlyphCache(const Font &font, uint8_t *arena, uint16_t arenaSize);
+
+  // Arena size that holds `numSlots` glyphs of `font`. Saturates at 0xFFFF,
+  // the largest arena there can be, which then holds fewer slots.
+  static uint16_t calcArenaSize(const Font &font, uint8_t numSlots);
+
+  MAMEFONT_INLINE uint8_t numSlots() const { return slotCount; }
+  MAMEFONT_INLINE uint32_t numHits() const { return hits; }
+  MAMEFONT_INLINE uint32_t numMisses() const { return misses; }
+
+  // Font::getGlyph() and decodeGlyph() in one, with `glyph->data` pointing
+  // into the arena. It stays valid until a later miss evicts the glyph.
+  // Glyphs that the font does not have are not cached nor counted.
+  Status getGlyph(uint8_t c, Glyph *glyph);
+
+  void clear();
+  MAMEFONT_INLINE void resetCounters() { hits = misses = 0; }
+
+ private:
+  void restoreSlot(Slot &slot, bool used);
+
+  Slot *slots;
+  frag_t *buffers;
+  frag_index_t bufferSize;
+  uint8_t slotCount;
+  uint8_t hand;
+  uint32_t hits;
+  uint32_t misses;
+};
+
+// Defined inline so that only the firmwares that use the cache compile it
+
+inline GlyphCache::GlyphCache(const Font &font, uint8_t *arena,
+                              uint16_t arenaSize)
+    : font(font), bufferSize(font.calcMaxGlyphBufferSize()) {
+  // The slots come first, aligned for Glyph, then the buffers
+  uint16_t padding = (alignof(Slot) - reinterpret_cast<uintptr_t>(arena) %
+                                          alignof(Slot)) %
+                     alignof(Slot);
+  uint16_t numSlots = 0;
+  if (arena && arenaSize > padding) {
+    numSlots = (arenaSize - padding) / (sizeof(Slot) + bufferSize);
+    if (numSlots > 255) numSlots = 255;
+  }
+  slotCount = numSlots;
+  slots = reinterpret_cast<Slot *>(arena + padding);
+  buffers = arena + padding + sizeof(Slot) * slotCount;
+  clear();
+}
+
+inline uint16_t GlyphCache::calcArenaSize(const Font &font, uint8_t numSlots) {
+  uint32_t size = (alignof(Slot) - 1) +
+                  static_cast<uint32_t>(numSlots) *
+                      (sizeof(Slot) + font.calcMaxGlyphBufferSize());
+  return size > 0xFFFF ? 0xFFFF : size;
+}
+
+inline Status GlyphCache::getGlyph(uint8_t c, Glyph *glyph) {
+  if (!glyph) {
+    MAMEFONT_THROW_OR_RETURN(Status::NULL_POINTER);
+  }
+
+  for (uint8_t i = 0; i < slotCount; i++) {
+    Slot &slot = slots[i];
+    if (slot.used && slot.code == c) {
+      slot.referenced = true;
+      hits++;
+      *glyph = slot.glyph;
+      return Status::SUCCESS;
+    }
+  }
+
+  if (slotCount == 0) {
+    MAMEFONT_THROW_OR_RETURN(Status::BUFFER_OVERRUN);
+  }
+
+  Status ret = font.getGlyph(c, glyph);
+  if (ret != Status::SUCCESS) return ret;
+
+  // Skips the referenced slots, clearing their marks on the way. Ends
+  // within one round since the marks are all clear by then.
+  uint8_t index = hand;
+  while (slots[index].used && slots[index].referenced) {
+    slots[index].referenced = false;
+    index = (index + 1 == slotCount) ? 0 : (index + 1);
+  }
+  hand = (index + 1 == slotCount) ? 0 : (index + 1);
+
+  // The victim is not cached while its buffer is overwritten, and comes
+  // back if the new glyph fails to decode
+  Slot &slot = slots[index];
+  bool victimUsed = slot.used;
+  slot.used = false;
+  glyph->data = buffers + index * bufferSize;
+#ifdef MAMEFONT_EXCEPTIONS
+  try {
+    ret = decodeGlyph(font, glyph);
+  } catch (const MameFontException &) {
+    restoreSlot(slot, victimUsed);
+    throw;
+  }
+#else
+  ret = decodeGlyph(font, glyph);
+#endif
+  if (ret != Status::SUCCESS) {
+    restoreSlot(slot, victimUsed);
+    return ret;
+  }
+
+  misses++;
+  slot.glyph = *glyph;
+  slot.code = c;
+  slot.used = true;
+  slot.referenced = true;
+  return Status::SUCCESS;
+}
+
+// Decodes the glyph of `slot` again over what a failed decode left in its
+// buffer. It decoded before, so this only fails if the font changed.
+inline void GlyphCache::restoreSlot(Slot &slot, bool used) {
+  if (!used) return;
+  Glyph glyph = slot.glyph;
+#ifdef MAMEFONT_EXCEPTIONS
+  try {
+    slot.used = decodeGlyph(font, &glyph) == Status::SUCCESS;
+  } catch (const MameFontException &) {
+  }
+#else
+  slot.used = decodeGlyph(font, &glyph) == Status::SUCCESS;
+#endif
+}
+
+inline void GlyphCache::clear() {
+  for (uint8_t i = 0; i < slotCount; i++) {
+    slots[i].used = false;
+    slots[i].referenced = false;
+  }
+  hand = 0;
+  resetCounters();
+}
+
+}  // namespace mamefont
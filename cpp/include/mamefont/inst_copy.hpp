@@ -15,15 +15,14 @@ namespace mamefont {
 #define MAMEFONT_COPY_CORE_CLASS MAMEFONT_NOINLINE
 #endif
 
+template <typename Traits>
 MAMEFONT_COPY_CORE_CLASS void copyCore(DecoderContext &ctx, Debugger &dbg,
                                        uint8_t cpxFlags, frag_index_t offset,
-                                       uint8_t length)
-#if defined(MAMEFONT_INCLUDE_IMPL) || defined(MAMEFONT_NO_CPX)
-{
+                                       uint8_t length) {
   frag_index_t readCursor = ctx.cursor;
   readCursor += offset;
 
-  frag_t frag;
+  frag_t frag = ctx.last;
   for (int8_t i = length; i != 0; i--) {
     frag_index_t ri;
     if (CPX::ByteReverse::read(cpxFlags)) {
@@ -32,25 +31,23 @@ MAMEFONT_COPY_CORE_CLASS void copyCore(DecoderContext &ctx, Debugger &dbg,
       ri = readCursor++;
     }
 
-    frag = (ri >= 0) ? ctx.data[ri] : 0x00;
+    frag = (ri >= 0) ? ctx.at<Traits>(ri) : 0x00;
 
-#ifndef MAMEFONT_NO_CPX
-    if (CPX::PixelReverse::read(cpxFlags)) {
-      frag = reversePixels(frag, ctx.flags.fragFormat());
+    if (Traits::CPX_ENABLED) {
+      if (CPX::PixelReverse::read(cpxFlags)) {
+        frag = reversePixels(frag, Traits::fragFormat(ctx.flags));
+      }
+      if (CPX::Inverse::read(cpxFlags)) {
+        frag = ~frag;
+      }
     }
-    if (CPX::Inverse::read(cpxFlags)) {
-      frag = ~frag;
-    }
-#endif
 
-    ctx.data[ctx.cursor++] = frag;
+    ctx.put<Traits>(frag);
   }
   ctx.last = frag;
 }
-#else
-    ;
-#endif
 
+template <typename Traits>
 static MAMEFONT_INLINE void CPY(DecoderContext &ctx, Debugger &dbg,
                                 uint8_t byte1) {
   uint8_t offset = CPY::Offset::read(byte1);
@@ -67,12 +64,12 @@ static MAMEFONT_INLINE void CPY(DecoderContext &ctx, Debugger &dbg,
     cpxFlags = 0;
     offset += length;
   }
-  copyCore(ctx, dbg, cpxFlags, -offset, length);
+  copyCore<Traits>(ctx, dbg, cpxFlags, -offset, length);
 
   MAMEFONT_AFTER_OP(dbg, ctx, length);
 }
 
-#ifndef MAMEFONT_NO_CPX
+template <typename Traits>
 static MAMEFONT_INLINE void CPX(DecoderContext &ctx, Debugger &dbg,
                                 uint8_t byte1) {
   uint8_t byte2 = ctx.fetch();
@@ -84,18 +81,19 @@ static MAMEFONT_INLINE void CPX(DecoderContext &ctx, Debugger &dbg,
       CPX::Offset::read((static_cast<uint16_t>(byte3) << 8) | byte2);
 
   bool byteReverse = CPX::ByteReverse::read(cpxFlags);
+#ifdef MAMEFONT_DEBUG
   bool pixelReverse = CPX::PixelReverse::read(cpxFlags);
   bool inverse = CPX::Inverse::read(cpxFlags);
+#endif
   MAMEFONT_BEFORE_OP(dbg, ctx, Operator::CPX,
                      "(ofst=%d, len=%d, byteRev=%d, bitRev=%d, inv=%d)",
                      (int)offset, (int)length, (int)byteReverse,
                      (int)pixelReverse, (int)inverse);
 
   if (byteReverse) offset -= length;
-  copyCore(ctx, dbg, cpxFlags, -offset, length);
+  copyCore<Traits>(ctx, dbg, cpxFlags, -offset, length);
 
   MAMEFONT_AFTER_OP(dbg, ctx, length);
 }
-#endif
 
 }  // namespace mamefont
@@ -9,13 +9,15 @@
 
 namespace mamefont {
 
+template <typename Traits>
 static MAMEFONT_INLINE void LDI(DecoderContext &ctx, Debugger &dbg,
                                 uint8_t byte1) {
   frag_t byte2 = ctx.fetch();
 
   MAMEFONT_BEFORE_OP(dbg, ctx, Operator::LDI, "(frag=0x%02X)", byte2);
 
-  ctx.last = ctx.data[ctx.cursor++] = byte2;
+  ctx.last = byte2;
+  ctx.put<Traits>(byte2);
 
   MAMEFONT_AFTER_OP(dbg, ctx, 1);
 }
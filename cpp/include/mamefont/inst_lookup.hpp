@@ -9,6 +9,7 @@
 
 namespace mamefont {
 
+template <typename Traits>
 static MAMEFONT_INLINE void LUP(DecoderContext &ctx, Debugger &dbg,
                                 uint8_t byte1) {
   uint8_t index = LUP::Index::read(byte1);
@@ -16,11 +17,13 @@ static MAMEFONT_INLINE void LUP(DecoderContext &ctx, Debugger &dbg,
   MAMEFONT_BEFORE_OP(dbg, ctx, Operator::LUP, "(idx=%d)", (int)index);
 
   frag_t frag = readBlobU8(ctx.fragTable + index);
-  ctx.last = ctx.data[ctx.cursor++] = frag;
+  ctx.last = frag;
+  ctx.put<Traits>(frag);
 
   MAMEFONT_AFTER_OP(dbg, ctx, 1);
 }
 
+template <typename Traits>
 static MAMEFONT_INLINE void LUD(DecoderContext &ctx, Debugger &dbg,
                                 uint8_t byte1) {
   uint8_t index = LUD::Index::read(byte1);
@@ -31,9 +34,10 @@ static MAMEFONT_INLINE void LUD(DecoderContext &ctx, Debugger &dbg,
 
   const frag_t *ptr = ctx.fragTable + index;
   frag_t frag = readBlobU8(ptr);
-  ctx.data[ctx.cursor++] = frag;
+  ctx.put<Traits>(frag);
   if (step) frag = readBlobU8(ptr + 1);
-  ctx.last = ctx.data[ctx.cursor++] = frag;
+  ctx.last = frag;
+  ctx.put<Traits>(frag);
 
   MAMEFONT_AFTER_OP(dbg, ctx, 2);
 }
@@ -9,6 +9,7 @@
 
 namespace mamefont {
 
+template <typename Traits>
 static MAMEFONT_INLINE void RPT(DecoderContext &ctx, Debugger &dbg,
                                 uint8_t byte1) {
   uint8_t repeatCount = RPT::RepeatCount::read(byte1);
@@ -17,7 +18,7 @@ static MAMEFONT_INLINE void RPT(DecoderContext &ctx, Debugger &dbg,
 
   frag_t last = ctx.last;
   for (uint8_t i = repeatCount; i != 0; i--) {
-    ctx.data[ctx.cursor++] = last;
+    ctx.put<Traits>(last);
   }
 
   MAMEFONT_AFTER_OP(dbg, ctx, repeatCount);
@@ -15,12 +15,6 @@ namespace mamefont {
 #define MAMEFONT_SHIFT_CORE_CLASS MAMEFONT_NOINLINE
 #endif
 
-#if defined(MAMEFONT_1BPP_ONLY)
-using shift_state_t = frag_t;
-#else
-using shift_state_t = uint16_t;
-#endif
-
 static MAMEFONT_INLINE uint16_t encodeShiftState2bpp(frag_t frag, bool right,
                                                      bool postSet) {
   uint16_t state = 0;
@@ -70,20 +64,21 @@ static MAMEFONT_INLINE frag_t decodeShiftState2bpp(uint16_t state) {
   return frag;
 }
 
+template <typename Traits>
 MAMEFONT_SHIFT_CORE_CLASS void shiftCore(DecoderContext &ctx, Debugger &dbg,
                                          uint8_t sfiFlags, uint8_t size,
-                                         uint8_t rpt, uint8_t period)
-#if defined(MAMEFONT_INCLUDE_IMPL) || defined(MAMEFONT_NO_SFI)
-{
+                                         uint8_t rpt, uint8_t period) {
+  using shift_state_t = typename Traits::shift_state_t;
   bool right = SFI::Right::read(sfiFlags);
-  bool bpp2 = (ctx.flags.fragFormat() != PixelFormat::BW_1BIT);
+  bool bpp2 = (Traits::fragFormat(ctx.flags) != PixelFormat::BW_1BIT);
   uint8_t stateWidth = bpp2 ? 12 : 8;
 
-#if defined(MAMEFONT_1BPP_ONLY)
-  shift_state_t modifier = getRightMaskU8(right ? (8 - size) : size);
-#else
-  shift_state_t modifier = getRightMaskU16(right ? (stateWidth - size) : size);
-#endif
+  shift_state_t modifier;
+  if (sizeof(shift_state_t) == 1) {
+    modifier = getRightMaskU8(right ? (8 - size) : size);
+  } else {
+    modifier = getRightMaskU16(right ? (stateWidth - size) : size);
+  }
   if (right) modifier = ~modifier;
 
   bool postSet = SFI::PostSet::read(sfiFlags);
@@ -127,16 +122,14 @@ MAMEFONT_SHIFT_CORE_CLASS void shiftCore(DecoderContext &ctx, Debugger &dbg,
     } else {
       last = state;
     }
-    ctx.data[ctx.cursor++] = last;
+    ctx.put<Traits>(last);
 
   } while (rpt != 0);
 
   ctx.last = last;
 }
-#else
-    ;
-#endif
 
+template <typename Traits>
 static MAMEFONT_INLINE void SFT(DecoderContext &ctx, Debugger &dbg,
                                 uint8_t byte1) {
   uint8_t size = SFT::Size::read(byte1);
@@ -145,19 +138,21 @@ static MAMEFONT_INLINE void SFT(DecoderContext &ctx, Debugger &dbg,
   static_assert(SFT::Right::MASK == SFI::Right::MASK &&
                     SFT::PostSet::MASK == SFI::PostSet::MASK,
                 "SFT and SFI flags must match");
+#ifdef MAMEFONT_DEBUG
   bool right = SFI::Right::read(sfiFlags);
   bool postSet = SFI::PostSet::read(sfiFlags);
+#endif
 
   MAMEFONT_BEFORE_OP(
       dbg, ctx, Operator::SFT, "(dir=%c, postOp=%c, size=%d, rpt=%d)",
       (right ? 'R' : 'L'), (postSet ? 'S' : 'C'), (int)size, (int)rpt);
 
-  shiftCore(ctx, dbg, sfiFlags, size, rpt, 1);
+  shiftCore<Traits>(ctx, dbg, sfiFlags, size, rpt, 1);
 
   MAMEFONT_AFTER_OP(dbg, ctx, rpt);
 }
 
-#ifndef MAMEFONT_NO_SFI
+template <typename Traits>
 static MAMEFONT_INLINE void SFI(DecoderContext &ctx, Debugger &dbg,
                                 uint8_t byte1) {
   uint8_t byte2 = ctx.fetch();
@@ -165,18 +160,19 @@ static MAMEFONT_INLINE void SFI(DecoderContext &ctx, Debugger &dbg,
   uint8_t period = SFI::Period::read(byte2);
   uint8_t sfiFlags =
       byte2 & (SFI::PreShift::MASK | SFI::Right::MASK | SFI::PostSet::MASK);
+#ifdef MAMEFONT_DEBUG
   bool right = SFI::Right::read(sfiFlags);
   bool postSet = SFI::PostSet::read(sfiFlags);
   bool preShift = SFI::PreShift::read(sfiFlags);
+#endif
 
   MAMEFONT_BEFORE_OP(dbg, ctx, Operator::SFI,
                      "(dir=%c, period=%d, shift1st=%d, postOp=%c, rpt=%d)",
                      (right ? 'R' : 'L'), (int)period, (preShift ? 1 : 0),
                      (postSet ? 'S' : 'C'), (int)rpt);
 
-  shiftCore(ctx, dbg, sfiFlags, 1, rpt, period);
+  shiftCore<Traits>(ctx, dbg, sfiFlags, 1, rpt, period);
 
   MAMEFONT_AFTER_OP(dbg, ctx, rpt * period + (preShift ? 1 : 0));
 }
-#endif
 }  // namespace mamefont
\ No newline at end of file
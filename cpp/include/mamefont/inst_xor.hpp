@@ -9,6 +9,7 @@
 
 namespace mamefont {
 
+template <typename Traits>
 static MAMEFONT_INLINE void XOR(DecoderContext &ctx, Debugger &dbg,
                                 uint8_t byte1) {
   uint8_t mask = XOR::Width2Bit::read(byte1) ? 0x03 : 0x01;
@@ -16,7 +17,8 @@ static MAMEFONT_INLINE void XOR(DecoderContext &ctx, Debugger &dbg,
 
   MAMEFONT_BEFORE_OP(dbg, ctx, Operator::XOR, "(mask=0x%02X)", mask);
 
-  ctx.last = ctx.data[ctx.cursor++] = ctx.last ^ mask;
+  ctx.last ^= mask;
+  ctx.put<Traits>(ctx.last);
 
   MAMEFONT_AFTER_OP(dbg, ctx, 1);
 }
@@ -3,8 +3,6 @@
 #include "mamefont/bit_field.hpp"
 #include "mamefont/mamefont_common.hpp"
 
-#ifdef MAMEFONT_DEBUG
-
 namespace mamefont {
 
 enum class Operator : int8_t {
@@ -64,6 +62,36 @@ static MAMEFONT_INLINE constexpr uint8_t instSizeOf(Operator op) {
   }
 }
 
+// Operator of the instruction that starts with `inst`, decided the same way
+// as the cascade in decodeGlyph(). NONE for undefined opcodes.
+static MAMEFONT_INLINE constexpr Operator operatorOf(uint8_t inst) {
+  if ((inst & 0x80) == 0) {
+    if ((inst & 0x40) == 0) return Operator::SFT;
+    if (((inst & 0x20) == 0) || ((inst & 0x07) != 0)) {
+      return (inst == 0x40) ? Operator::CPX : Operator::CPY;
+    }
+    if ((inst & 0x10) == 0) {
+      return ((inst & 0x08) == 0) ? Operator::LDI : Operator::SFI;
+    }
+    return Operator::NONE;
+  }
+  if ((inst & 0x40) == 0) return Operator::LUP;
+  if ((inst & 0x20) == 0) return Operator::LUD;
+  if ((inst & 0x10) == 0) return Operator::RPT;
+  return (inst == 0xFF) ? Operator::ABO : Operator::XOR;
+}
+
+// operatorOf() for every opcode, for the table dispatch
+struct OperatorTable {
+  Operator ops[256];
+
+  constexpr OperatorTable() : ops() {
+    for (int i = 0; i < 256; i++) {
+      ops[i] = operatorOf(i);
+    }
+  }
+};
+
 struct LUP {
   static constexpr uint8_t SIZE = 1;
   using Index = BitField<uint8_t, uint8_t, 0, 0, 6>;
@@ -163,5 +191,3 @@ const char *mnemonicOf(Operator op) {
 #endif
 
 }  // namespace mamefont
-
-#endif
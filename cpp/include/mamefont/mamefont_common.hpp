@@ -18,6 +18,14 @@
 #define MAMEFONT_INLINE inline __attribute__((always_inline))
 #define MAMEFONT_NOINLINE __attribute__((noinline))
 
+// Define MAMEFONT_TABLE_DISPATCH to dispatch opcodes through a 256-entry
+// table instead of the branch cascade. The table costs 256 bytes of memory
+// and shows no consistent gain on x86-64, where example/decode_bench varies
+// by more than the difference between the two. It is never used on AVR.
+#if defined(MAMEFONT_TABLE_DISPATCH) && defined(__AVR__)
+#undef MAMEFONT_TABLE_DISPATCH
+#endif
+
 namespace mamefont {
 
 #ifdef MAMEFONT_USE_PROGMEM
@@ -0,0 +1,81 @@
+#pragma once
+
+#ifdef MAMEFONT_EXCEPTIONS
+#include <stdexcept>
+#endif
+
+#include "mamefont/debugger.hpp"
+#include "mamefont/decoder.hpp"
+#include "mamefont/decoder_context.hpp"
+#include "mamefont/decoder_traits.hpp"
+#include "mamefont/font.hpp"
+#include "mamefont/glyph.hpp"
+#include "mamefont/mamefont_common.hpp"
+
+// Opt-in: mamefont.hpp does not include this header, and nothing in it is
+// compiled unless it is called.
+
+namespace mamefont {
+
+// Decodes `glyph` into `ring`, a buffer of `ringSize` fragments of which a
+// whole number of tracks is used, and hands each track to `sink` as soon as
+// it is complete. `glyph->data` is not used.
+//
+// The ring must hold as many fragments as the longest copy of the glyph
+// reads back, which mamec reports as the stream buffer size of the font.
+// Font::calcMaxGlyphBufferSize() is always enough. If a copy reads back
+// further than the ring holds, decoding stops there and BUFFER_OVERRUN is
+// returned. The tracks completed before are handed to the sink as usual,
+// but none that the copy was writing to.
+template <typename Traits>
+Status decodeStream(const Font &font, Glyph *glyph, frag_t *ring,
+                    frag_index_t ringSize, TrackSink sink, void *sinkContext,
+                    Debugger &dbg) {
+  if (!glyph || !ring || !sink) {
+    MAMEFONT_THROW_OR_RETURN(Status::NULL_POINTER);
+  }
+  if (!glyph->isValid()) {
+    MAMEFONT_THROW_OR_RETURN(Status::GLYPH_NOT_DEFINED);
+  }
+
+  using Stream = StreamingTraits<Traits>;
+  StreamContext ctx(font, glyph, Stream());
+  ctx.data = ring;
+  if (ctx.trackLength == 0 || ringSize < ctx.trackLength) {
+    MAMEFONT_THROW_OR_RETURN(Status::BUFFER_OVERRUN);
+  }
+  ctx.ringSize = ringSize - ringSize % ctx.trackLength;
+  ctx.trackEnd = ctx.trackLength;
+  ctx.sink = sink;
+  ctx.sinkContext = sinkContext;
+#ifdef MAMEFONT_DEBUG
+  dbg.init(glyph, ctx, true);
+#endif
+
+  // As in decodeString(), the byte code writes every fragment, so there is
+  // nothing to clear for the alternative top and bottom
+  Status ret = runDecoder<Stream>(ctx, dbg);
+  if (ret != Status::SUCCESS) return ret;
+  if (ctx.windowExceeded) {
+    MAMEFONT_THROW_OR_RETURN(Status::BUFFER_OVERRUN);
+  }
+  return Status::SUCCESS;
+}
+
+template <typename Traits>
+MAMEFONT_INLINE Status decodeStream(const Font &font, Glyph *glyph,
+                                    frag_t *ring, frag_index_t ringSize,
+                                    TrackSink sink, void *sinkContext) {
+  Debugger dbg{};
+  return decodeStream<Traits>(font, glyph, ring, ringSize, sink, sinkContext,
+                              dbg);
+}
+
+MAMEFONT_INLINE Status decodeStream(const Font &font, Glyph *glyph,
+                                    frag_t *ring, frag_index_t ringSize,
+                                    TrackSink sink, void *sinkContext) {
+  return decodeStream<RuntimeTraits>(font, glyph, ring, ringSize, sink,
+                                     sinkContext);
+}
+
+}  // namespace mamefont
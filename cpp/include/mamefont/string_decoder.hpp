@@ -0,0 +1,105 @@
+#pragma once
+
+#ifdef MAMEFONT_EXCEPTIONS
+#include <stdexcept>
+#endif
+
+#include "mamefont/debugger.hpp"
+#include "mamefont/decoder.hpp"
+#include "mamefont/decoder_context.hpp"
+#include "mamefont/decoder_traits.hpp"
+#include "mamefont/font.hpp"
+#include "mamefont/glyph.hpp"
+#include "mamefont/mamefont_common.hpp"
+
+// Not included by mamefont.hpp. Everything here is a template or inline, so
+// including it costs nothing in the firmwares that draw glyph by glyph.
+
+namespace mamefont {
+
+// A character of a string laid out by layoutString()
+struct StringGlyph {
+  Glyph glyph;
+  // Left edge of the glyph from the start of the string
+  int16_t x;
+};
+
+// Reads the glyph entries of the `len` characters of `str` into `glyphs`
+// and lays them out from x = 0: each glyph steps back by its xStepBack and
+// advances by its width and xSpace. Characters out of the font's range take
+// no space. The glyphs are given consecutive areas of `strip`, or none if
+// they are not valid. Returns the number of fragments the string needs in
+// the strip and stores its advance in `width`.
+template <typename Traits = RuntimeTraits>
+uint16_t layoutString(const Font &font, const char *str, uint16_t len,
+                      StringGlyph *glyphs, frag_t *strip = nullptr,
+                      int16_t *width = nullptr) {
+  uint16_t stripPos = 0;
+  int16_t x = 0;
+  for (uint16_t i = 0; i < len; i++) {
+    Glyph *glyph = &glyphs[i].glyph;
+    *glyph = Glyph();
+    font.getGlyph(static_cast<uint8_t>(str[i]), glyph);
+
+    x -= glyph->xStepBack;
+    glyphs[i].x = x;
+    x += glyph->glyphWidth + glyph->xSpace;
+
+    if (glyph->isValid()) {
+      uint8_t numTracks, trackLength;
+      Traits::getBufferShape(glyph, &numTracks, &trackLength);
+      if (strip) glyph->data = strip + stripPos;
+      stripPos += numTracks * trackLength;
+    }
+  }
+  if (width) *width = x;
+  return stripPos;
+}
+
+// Decodes the `len` characters of `str` back to back into `strip`, with the
+// layout of layoutString() stored in `glyphs`. The blob is located and the
+// glyph entries are read once for the whole string before decoding.
+// Returns BUFFER_OVERRUN without decoding if `strip` cannot hold
+// `stripSize` fragments for the string.
+template <typename Traits>
+Status decodeString(const Font &font, const char *str, uint16_t len,
+                    StringGlyph *glyphs, frag_t *strip, uint16_t stripSize,
+                    int16_t *width = nullptr) {
+  if (!str || !glyphs || !strip) {
+    MAMEFONT_THROW_OR_RETURN(Status::NULL_POINTER);
+  }
+  if (layoutString<Traits>(font, str, len, glyphs, strip, width) >
+      stripSize) {
+    MAMEFONT_THROW_OR_RETURN(Status::BUFFER_OVERRUN);
+  }
+
+  FontFlags flags = font.flags();
+  const frag_t *fragTable = font.blob + font.fragmentTableOffset();
+  const uint8_t *bytecode = fragTable + font.fragmentTableSize();
+
+  // The byte code of a glyph writes all of its fragments, so the strip is
+  // not cleared for the alternative top and bottom as in decodeGlyph()
+  Debugger dbg{};
+  for (uint16_t i = 0; i < len; i++) {
+    Glyph *glyph = &glyphs[i].glyph;
+    if (!glyph->isValid()) continue;
+
+    DecoderContext ctx(flags, fragTable, bytecode, glyph, Traits());
+#ifdef MAMEFONT_DEBUG
+    dbg.init(glyph, ctx);
+#endif
+    Status ret = runDecoder<Traits>(ctx, dbg);
+    if (ret != Status::SUCCESS) return ret;
+  }
+  return Status::SUCCESS;
+}
+
+MAMEFONT_INLINE Status decodeString(const Font &font, const char *str,
+                                    uint16_t len, StringGlyph *glyphs,
+                                    frag_t *strip, uint16_t stripSize,
+                                    int16_t *width = nullptr) {
+  return decodeString<RuntimeTraits>(font, str, len, glyphs, strip, stripSize,
+                                     width);
+}
+
+}  // namespace mamefont
@@ -0,0 +1,200 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <mamefont/mamefont.hpp>
+
+#include <font/MameSansP_s48c40w08.hpp>
+#include <font/ShapoSansDigitP_s16c14w02.hpp>
+#include <font/ShapoSansP_s12c09a01w02.hpp>
+
+namespace mf = mamefont;
+
+// Same decoder with the opcode dispatch chosen explicitly
+template <bool TABLE>
+struct BenchTraits : mf::RuntimeTraits {
+  static constexpr bool TABLE_DISPATCH = TABLE;
+};
+
+struct BenchFont {
+  const char *name;
+  const uint8_t *blob;
+};
+
+static const BenchFont FONTS[] = {
+    {"ShapoSansDigitP_s16c14w02", ShapoSansDigitP_s16c14w02_blob},
+    {"ShapoSansP_s12c09a01w02", ShapoSansP_s12c09a01w02_blob},
+    {"MameSansP_s48c40w08", MameSansP_s48c40w08_blob},
+};
+
+static constexpr int NUM_PASSES = 1000;
+// The best of several trials is taken to filter out noise
+static constexpr int NUM_TRIALS = 7;
+
+// Counts the CPU instructions retired in user space, where the kernel
+// allows it
+class InstCounter {
+ public:
+  InstCounter() {
+#ifdef __linux__
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+  }
+
+  ~InstCounter() {
+#ifdef __linux__
+    if (fd >= 0) close(fd);
+#endif
+  }
+
+  bool available() const { return fd >= 0; }
+
+  void start() {
+#ifdef __linux__
+    if (fd < 0) return;
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+  }
+
+  uint64_t stop() {
+    uint64_t count = 0;
+#ifdef __linux__
+    if (fd < 0) return 0;
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &count, sizeof(count)) != sizeof(count)) count = 0;
+#endif
+    return count;
+  }
+
+ private:
+  int fd = -1;
+};
+
+struct Result {
+  double instsPerFrag;
+  double nsPerFrag;
+};
+
+template <bool TABLE>
+static Result measure(const mf::Font &font, std::vector<mf::Glyph> &glyphs,
+                      int numFrags, InstCounter &counter) {
+  // Warm up the caches and the branch predictor first
+  for (auto &glyph : glyphs) {
+    mf::decodeGlyph<BenchTraits<TABLE>>(font, &glyph);
+  }
+
+  double totalFrags = (double)numFrags * NUM_PASSES;
+  Result best{0, 0};
+  for (int trial = 0; trial < NUM_TRIALS; trial++) {
+    auto startTime = std::chrono::steady_clock::now();
+    counter.start();
+    for (int pass = 0; pass < NUM_PASSES; pass++) {
+      for (auto &glyph : glyphs) {
+        mf::decodeGlyph<BenchTraits<TABLE>>(font, &glyph);
+      }
+    }
+    uint64_t insts = counter.stop();
+    auto elapsed = std::chrono::steady_clock::now() - startTime;
+
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+    Result result{insts / totalFrags, ns / totalFrags};
+    if (trial == 0 || result.nsPerFrag < best.nsPerFrag) {
+      best.nsPerFrag = result.nsPerFrag;
+    }
+    if (trial == 0 || result.instsPerFrag < best.instsPerFrag) {
+      best.instsPerFrag = result.instsPerFrag;
+    }
+  }
+  return best;
+}
+
+static bool benchFont(const BenchFont &bench, InstCounter &counter) {
+  const mf::Font font(bench.blob);
+  int buffSize = font.calcMaxGlyphBufferSize();
+
+  // Every glyph gets its own buffer so that a pass decodes the whole font
+  std::vector<mf::Glyph> glyphs;
+  std::vector<uint8_t> buff;
+  int numFrags = 0;
+  for (int code = font.firstCode(); code <= font.lastCode(); code++) {
+    mf::Glyph glyph;
+    if (font.getGlyph(code, &glyph) != mf::Status::SUCCESS) continue;
+    uint8_t numTracks, trackLength;
+    glyph.getBufferShape(&numTracks, &trackLength);
+    numFrags += numTracks * trackLength;
+    glyphs.push_back(glyph);
+  }
+  buff.resize(glyphs.size() * buffSize * 2);
+
+  // Both dispatches must decode the same fragments
+  for (size_t i = 0; i < glyphs.size(); i++) {
+    mf::Glyph cascade = glyphs[i];
+    mf::Glyph table = glyphs[i];
+    cascade.data = &buff[(i * 2) * buffSize];
+    table.data = &buff[(i * 2 + 1) * buffSize];
+    mf::Status ret1 = mf::decodeGlyph<BenchTraits<false>>(font, &cascade);
+    mf::Status ret2 = mf::decodeGlyph<BenchTraits<true>>(font, &table);
+    if (ret1 != mf::Status::SUCCESS || ret2 != mf::Status::SUCCESS ||
+        memcmp(cascade.data, table.data, buffSize) != 0) {
+      printf("*ERROR: %s: dispatch mismatch in glyph #%d\n", bench.name,
+             (int)i);
+      return false;
+    }
+    glyphs[i].data = cascade.data;
+  }
+
+  Result cascade = measure<false>(font, glyphs, numFrags, counter);
+  Result table = measure<true>(font, glyphs, numFrags, counter);
+
+  printf("%-28s %7d", bench.name, numFrags);
+  if (counter.available()) {
+    printf("  %9.2f %9.2f %+7.1f%%", cascade.instsPerFrag, table.instsPerFrag,
+           100.0 * (table.instsPerFrag / cascade.instsPerFrag - 1));
+  }
+  printf("  %7.2f %7.2f %+7.1f%%\n", cascade.nsPerFrag, table.nsPerFrag,
+         100.0 * (table.nsPerFrag / cascade.nsPerFrag - 1));
+  return true;
+}
+
+int main(int argc, char **argv) {
+  InstCounter counter;
+  if (!counter.available()) {
+    printf("(Instruction counter not available, timing only)\n");
+  }
+
+  printf("%-28s %7s", "Font", "Frags");
+  if (counter.available()) {
+    printf("  %9s %9s %8s", "Inst/Frag", "", "");
+  }
+  printf("  %7s %7s %8s\n", "ns/Frag", "", "");
+  printf("%-28s %7s", "", "");
+  if (counter.available()) {
+    printf("  %9s %9s %8s", "Cascade", "Table", "Diff");
+  }
+  printf("  %7s %7s %8s\n", "Cascade", "Table", "Diff");
+
+  bool success = true;
+  for (const auto &bench : FONTS) {
+    success &= benchFont(bench, counter);
+  }
+  return success ? 0 : 1;
+}